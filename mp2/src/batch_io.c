@@ -0,0 +1,195 @@
+/*
+ * File:   batch_io.c
+ *
+ * Batched datagram I/O for the reliable sender and receiver.
+ */
+
+#include "batch_io.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+// point every message at its own buffer; addr is where sends go, NULL
+// for a batch that only receives.  Offload is only turned on if the
+// kernel knows UDP_SEGMENT (sending) or accepts UDP_GRO (receiving).
+void batch_init(batch_t* batch, int sockfd, int size, int offload, struct sockaddr* addr, socklen_t addr_len) {
+	int i, on = 1, gso;
+	socklen_t len = sizeof(gso);
+	memset(batch, 0, sizeof(*batch));
+	batch->size = size;
+	if (offload && addr != NULL && getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &gso, &len) == 0)
+		batch->offload = 1;
+	if (offload && addr == NULL && setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0)
+		batch->offload = 1;
+
+	batch->buf_len = batch->offload && addr == NULL ? GRO_BUFLEN : MAXBUFLEN;
+	batch->bufs = malloc(BATCH_MAX * batch->buf_len);
+	if (batch->bufs == NULL) {
+		perror("batch_init: malloc");
+		exit(1);
+	}
+	for (i = 0; i < BATCH_MAX; i++) {
+		batch->iovs[i].iov_base = batch->bufs + i * batch->buf_len;
+		batch->iovs[i].iov_len = batch->buf_len;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = addr;
+		batch->msgs[i].msg_hdr.msg_namelen = addr_len;
+	}
+}
+
+// buffer for the next datagram to queue
+char* batch_slot(batch_t* batch) {
+	return batch->bufs + batch->count * batch->buf_len;
+}
+
+// queue the datagram written to batch_slot(), sending the batch once full
+void batch_push(batch_t* batch, int sockfd, int len) {
+	batch_push_data(batch, sockfd, len, NULL, 0);
+}
+
+// queue the len bytes written to batch_slot() followed by data_len
+// bytes at data, which must stay put until the batch is flushed
+void batch_push_data(batch_t* batch, int sockfd, int len, char* data, int data_len) {
+	batch->lens[batch->count] = len + data_len;
+	batch->data[batch->count].iov_base = data;
+	batch->data[batch->count].iov_len = data_len;
+	batch->count++;
+	if (batch->count == batch->size)
+		batch_flush(batch, sockfd);
+}
+
+// add the iovecs of queued datagram i at iovs[k]; returns the next free k
+static int add_iovs(batch_t* batch, int i, int k) {
+	batch->iovs[k].iov_base = batch->bufs + i * batch->buf_len;
+	batch->iovs[k].iov_len = batch->lens[i] - batch->data[i].iov_len;
+	k++;
+	if (batch->data[i].iov_len > 0)
+		batch->iovs[k++] = batch->data[i];
+	return k;
+}
+
+// one message per queued datagram from first on, or with offload one
+// per run of equal-sized datagrams (the last may be shorter), which
+// the kernel splits up again; returns the number of messages
+static int build_messages(batch_t* batch, int first) {
+	int i = first, n = 0, k = 0, start, first_iov;
+	struct msghdr* hdr;
+	struct cmsghdr* cm;
+	while (i < batch->count) {
+		start = i;
+		first_iov = k;
+		k = add_iovs(batch, i++, k);
+		while (batch->offload && i < batch->count && i - start < GSO_SEGMENTS
+		       && batch->lens[i - 1] == batch->lens[start] && batch->lens[i] <= batch->lens[start])
+			k = add_iovs(batch, i++, k);
+
+		hdr = &batch->msgs[n].msg_hdr;
+		hdr->msg_iov = &batch->iovs[first_iov];
+		hdr->msg_iovlen = k - first_iov;
+		batch->segs[n] = i - start;
+		hdr->msg_control = NULL;
+		hdr->msg_controllen = 0;
+		if (i - start > 1) {
+			hdr->msg_control = batch->ctrl[n];
+			hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+			cm = CMSG_FIRSTHDR(hdr);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*(uint16_t*)CMSG_DATA(cm) = batch->lens[start];
+		}
+		n++;
+	}
+	return n;
+}
+
+// send every queued datagram; if the kernel or the device turns a
+// super-packet down, offload is dropped and the rest goes out plainly
+void batch_flush(batch_t* batch, int sockfd) {
+	int first = 0, n, numsent, i;
+	while (first < batch->count) {
+		n = build_messages(batch, first);
+		numsent = sendmmsg(sockfd, batch->msgs, n, 0);
+		if (numsent == -1) {
+			if (errno == EINTR)
+				continue;
+			if (batch->offload && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+				fprintf(stderr, "sendmmsg: UDP GSO unavailable (%s), sending plain datagrams\n", strerror(errno));
+				batch->offload = 0;
+				continue;
+			}
+			perror("sendmmsg");
+			exit(1);
+		}
+		for (i = 0; i < numsent; i++)
+			first += batch->segs[i];
+		batch->messages += numsent;
+	}
+	batch->datagrams += batch->count;
+	batch->count = 0;
+}
+
+// wait for at least one message, subject to the socket's receive
+// timeout, then take whatever else has already arrived; read the
+// datagrams out with batch_next()
+int batch_recv(batch_t* batch, int sockfd) {
+	int i;
+	for (i = 0; i < batch->size; i++) {
+		batch->iovs[i].iov_len = batch->buf_len;
+		batch->msgs[i].msg_hdr.msg_control = batch->offload ? batch->ctrl[i] : NULL;
+		batch->msgs[i].msg_hdr.msg_controllen = batch->offload ? sizeof(batch->ctrl[i]) : 0;
+	}
+	batch->count = recvmmsg(sockfd, batch->msgs, batch->size, MSG_WAITFORONE, NULL);
+	if (batch->count < 0)
+		batch->count = 0;
+	batch->messages += batch->count;
+	batch->next_msg = 0;
+	batch->next_off = 0;
+	return batch->count;
+}
+
+// GRO segment size of a received message, its whole length if the
+// kernel did not coalesce it
+static int gro_size(struct msghdr* hdr, int len) {
+	struct cmsghdr* cm;
+	for (cm = CMSG_FIRSTHDR(hdr); cm != NULL; cm = CMSG_NXTHDR(hdr, cm)) {
+		if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+			return *(int*)CMSG_DATA(cm);
+	}
+	return len;
+}
+
+// next datagram of the last batch_recv(); returns its length, or -1
+// once every message has been read
+int batch_next(batch_t* batch, char** dgram) {
+	int len, seg;
+	while (batch->next_msg < batch->count) {
+		len = batch->msgs[batch->next_msg].msg_len;
+		if (batch->next_off < len) {
+			if (batch->next_off == 0)
+				batch->next_seg = gro_size(&batch->msgs[batch->next_msg].msg_hdr, len);
+			seg = len - batch->next_off;
+			if (seg > batch->next_seg)
+				seg = batch->next_seg;
+			*dgram = batch->bufs + batch->next_msg * batch->buf_len + batch->next_off;
+			batch->next_off += seg;
+			batch->datagrams++;
+			return seg;
+		}
+		batch->next_msg++;
+		batch->next_off = 0;
+	}
+	return -1;
+}
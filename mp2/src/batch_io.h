@@ -0,0 +1,51 @@
+/*
+ * File:   batch_io.h
+ *
+ * Batched datagram I/O: up to BATCH_MAX messages per sendmmsg() or
+ * recvmmsg() call, out of buffers allocated once up front.  With
+ * offload on, runs of equal-sized datagrams go out as one UDP GSO
+ * super-packet and GRO-coalesced receives are split up again.
+ * A queued datagram may carry its payload by reference, sent from
+ * where it lies without being copied into the batch.
+ */
+
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define MAXBUFLEN	1472
+#define BATCH_MAX	64
+#define GSO_SEGMENTS	44		// full datagrams in one 64 KB super-packet
+#define GRO_BUFLEN	65536	// room for a whole coalesced receive
+
+typedef struct {
+	int size;							// messages per syscall, 1..BATCH_MAX
+	int count;							// datagrams queued, or messages received
+	int offload;						// GSO when sending, GRO when receiving
+	size_t buf_len;						// bytes per buffer
+	char* bufs;							// BATCH_MAX buffers, back to back
+	int lens[BATCH_MAX];				// length of each queued datagram
+	struct iovec data[BATCH_MAX];		// payload sent by reference, if any
+	struct mmsghdr msgs[BATCH_MAX];
+	int segs[BATCH_MAX];				// datagrams in each message sent
+	struct iovec iovs[2 * BATCH_MAX];	// buffer and payload of each datagram
+	char ctrl[BATCH_MAX][64];			// UDP_SEGMENT / UDP_GRO control messages
+	int next_msg;						// batch_next() position: message,
+	int next_off;						// offset into it,
+	int next_seg;						// and its GRO segment size
+	long messages;						// messages sent or received so far
+	long datagrams;						// datagrams they carried
+} batch_t;
+
+void batch_init(batch_t* batch, int sockfd, int size, int offload, struct sockaddr* addr, socklen_t addr_len);
+char* batch_slot(batch_t* batch);
+void batch_push(batch_t* batch, int sockfd, int len);
+void batch_push_data(batch_t* batch, int sockfd, int len, char* data, int data_len);
+void batch_flush(batch_t* batch, int sockfd);
+int batch_recv(batch_t* batch, int sockfd);
+int batch_next(batch_t* batch, char** dgram);
+
+#endif
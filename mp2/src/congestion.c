@@ -0,0 +1,256 @@
+/*
+ * File:   congestion.c
+ *
+ * NewReno, CUBIC and a BBR-style controller behind one interface.
+ */
+
+#include "congestion.h"
+
+#include <math.h>
+#include <string.h>
+
+#define CUBIC_C		0.4
+#define CUBIC_BETA	0.7
+
+#define STARTUP		0
+#define DRAIN		1
+#define PROBE_BW	2
+
+#define BBR_HIGH_GAIN	2.885	// 2 / ln 2, doubles delivery each round
+
+// PROBE_BW spends one round above the estimated bandwidth, one below
+// to drain what that queued, then six at it
+static const double bbr_gains[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+
+// NewReno: slow start to ssthresh, then one segment per window; a
+// loss halves the window
+static void reno_ack(cc_t* cc, uint64_t now, uint64_t sent, long delivered) {
+	(void)now;
+	(void)sent;
+	(void)delivered;
+	if (cc->cwnd < cc->ssthresh)
+		cc->cwnd += 1;
+	else
+		cc->cwnd += 1 / cc->cwnd;
+}
+
+static void reno_loss(cc_t* cc, uint64_t now) {
+	(void)now;
+	cc->ssthresh = cc->cwnd / 2;
+	if (cc->ssthresh < 2)
+		cc->ssthresh = 2;
+	cc->cwnd = cc->ssthresh;
+}
+
+
+// CUBIC (RFC 8312): after a loss the window follows a cubic in the
+// time since, flat around the window the loss happened at and steep
+// away from it, never below what Reno would have reached
+static void cubic_ack(cc_t* cc, uint64_t now, uint64_t sent, long delivered) {
+	double t, target, reno;
+	(void)sent;
+	(void)delivered;
+	if (cc->cwnd < cc->ssthresh) {
+		cc->cwnd += 1;
+		return;
+	}
+	if (cc->epoch_start == 0) {
+		cc->epoch_start = now;
+		if (cc->cwnd < cc->w_max) {
+			cc->k = cbrt((cc->w_max - cc->cwnd) / CUBIC_C);
+		} else {
+			cc->k = 0;
+			cc->w_max = cc->cwnd;
+		}
+	}
+	// aim for where the curve will be an RTT from now
+	t = (now - cc->epoch_start + cc->srtt) / 1e6;
+	target = cc->w_max + CUBIC_C * (t - cc->k) * (t - cc->k) * (t - cc->k);
+	if (cc->srtt > 0) {
+		reno = cc->w_max * CUBIC_BETA + 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA)
+			* (double)(now - cc->epoch_start) / cc->srtt;
+		if (target < reno)
+			target = reno;
+	}
+	if (target > cc->cwnd)
+		cc->cwnd += (target - cc->cwnd) / cc->cwnd;
+	else
+		cc->cwnd += 0.01 / cc->cwnd;
+}
+
+static void cubic_loss(cc_t* cc, uint64_t now) {
+	(void)now;
+	cc->epoch_start = 0;
+	// losing again short of the last peak: give up some of it
+	if (cc->cwnd < cc->w_max)
+		cc->w_max = cc->cwnd * (1 + CUBIC_BETA) / 2;
+	else
+		cc->w_max = cc->cwnd;
+	cc->cwnd *= CUBIC_BETA;
+	if (cc->cwnd < 2)
+		cc->cwnd = 2;
+	cc->ssthresh = cc->cwnd;
+}
+
+
+// BBR-style: every ACK gives a delivery rate, the segments acked
+// since the one acked now was sent over the time since; the best of
+// the last rounds (a round ends once a segment sent after it began is
+// acked) is the bottleneck bandwidth.  The window is a multiple of
+// bandwidth x min RTT rather than a reaction to loss.  Startup doubles
+// the window each round until the bandwidth stops growing by a quarter
+// for three rounds, drains the queue that built, then cycles its gain
+// to keep probing.
+static double bbr_bdp(cc_t* cc) {
+	return cc->btl_bw * cc->min_rtt;
+}
+
+static void bbr_round(cc_t* cc) {
+	int i;
+	double bdp;
+	cc->bw_samples[cc->round % CC_BW_ROUNDS] = cc->round_bw;
+	cc->btl_bw = 0;
+	for (i = 0; i < CC_BW_ROUNDS; i++) {
+		if (cc->bw_samples[i] > cc->btl_bw)
+			cc->btl_bw = cc->bw_samples[i];
+	}
+	cc->round++;
+	cc->round_end = cc->acked;
+	cc->round_bw = 0;
+	bdp = bbr_bdp(cc);
+
+	if (cc->mode == STARTUP) {
+		if (cc->btl_bw >= cc->full_bw * 1.25) {
+			cc->full_bw = cc->btl_bw;
+			cc->full_bw_rounds = 0;
+		} else if (++cc->full_bw_rounds >= 3) {
+			cc->mode = DRAIN;
+		}
+	} else if (cc->mode == DRAIN) {
+		cc->mode = PROBE_BW;
+		cc->cycle = 0;
+	} else {
+		cc->cycle = (cc->cycle + 1) % 8;
+	}
+
+	if (cc->mode == DRAIN)
+		cc->cwnd = bdp;
+	else if (cc->mode == PROBE_BW)
+		cc->cwnd = 2 * bbr_gains[cc->cycle] * bdp;
+	if (cc->cwnd < 4)
+		cc->cwnd = 4;
+}
+
+static void bbr_init(cc_t* cc, uint64_t now) {
+	(void)now;
+	cc->mode = STARTUP;
+}
+
+static void bbr_ack(cc_t* cc, uint64_t now, uint64_t sent, long delivered) {
+	double bw;
+	if (sent != 0 && now > sent) {
+		bw = (double)(cc->acked - delivered) / (now - sent);
+		if (bw > cc->round_bw)
+			cc->round_bw = bw;
+	}
+	if (cc->mode == STARTUP)
+		cc->cwnd += 1;
+	if (delivered >= cc->round_end)
+		bbr_round(cc);
+}
+
+static void bbr_loss(cc_t* cc, uint64_t now) {
+	(void)cc;
+	(void)now;
+}
+
+// the bandwidth estimate times the gain of the mode: well above it in
+// startup, below it to drain, then the probing cycle; until there is an
+// estimate, startup paces the window over the RTT
+static double bbr_pacing_rate(cc_t* cc) {
+	if (cc->btl_bw == 0)
+		return cc->srtt == 0 ? 0 : BBR_HIGH_GAIN * cc->cwnd / cc->srtt;
+	if (cc->mode == STARTUP)
+		return BBR_HIGH_GAIN * cc->btl_bw;
+	if (cc->mode == DRAIN)
+		return cc->btl_bw / BBR_HIGH_GAIN;
+	return bbr_gains[cc->cycle] * cc->btl_bw;
+}
+
+
+static const cc_ops_t controllers[] = {
+	{ "reno", NULL, reno_ack, reno_loss, NULL, NULL },
+	{ "cubic", NULL, cubic_ack, cubic_loss, NULL, NULL },
+	{ "bbr", bbr_init, bbr_ack, bbr_loss, NULL, bbr_pacing_rate },
+};
+
+// pick a controller by name; returns 0 if there is none of that name
+int cc_select(cc_t* cc, const char* name) {
+	unsigned int i;
+	for (i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+		if (strcmp(controllers[i].name, name) == 0) {
+			cc->ops = &controllers[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// start a transfer with the selected controller; the window never
+// grows past max_cwnd segments
+void cc_init(cc_t* cc, int max_cwnd, uint64_t now) {
+	const cc_ops_t* ops = cc->ops;
+	memset(cc, 0, sizeof(*cc));
+	cc->ops = ops;
+	cc->cwnd = CC_INIT_CWND;
+	cc->ssthresh = max_cwnd;
+	cc->max_cwnd = max_cwnd;
+	if (ops->init != NULL)
+		ops->init(cc, now);
+}
+
+// one segment newly acknowledged, sent at sent when delivered
+// segments had been acknowledged; sent is 0 if the ACK may be for an
+// earlier copy of it, which leaves the delivery rate unsampled
+void cc_ack(cc_t* cc, uint64_t now, uint64_t sent, long delivered) {
+	cc->acked++;
+	cc->ops->on_ack(cc, now, sent, delivered);
+	if (cc->cwnd > cc->max_cwnd)
+		cc->cwnd = cc->max_cwnd;
+}
+
+// a segment was lost; the sender reports one loss per window of data
+void cc_loss(cc_t* cc, uint64_t now) {
+	cc->losses++;
+	cc->ops->on_loss(cc, now);
+}
+
+// an RTT sample, in usec
+void cc_rtt(cc_t* cc, uint64_t rtt, uint64_t now) {
+	if (rtt == 0)
+		rtt = 1;
+	cc->srtt = cc->srtt == 0 ? rtt : (7 * cc->srtt + rtt) / 8;
+	if (cc->min_rtt == 0 || rtt < cc->min_rtt)
+		cc->min_rtt = rtt;
+	if (cc->ops->on_rtt != NULL)
+		cc->ops->on_rtt(cc, rtt, now);
+}
+
+// the window in whole segments, at least 1
+int cc_window(cc_t* cc) {
+	if (cc->cwnd < 1)
+		return 1;
+	return (int)cc->cwnd;
+}
+
+// the rate to pace segments at, in segments per usec, 0 before there
+// is an RTT to pace over; by default the window per smoothed RTT, with
+// headroom for the window to grow
+double cc_pacing_rate(cc_t* cc) {
+	if (cc->ops->pacing_rate != NULL)
+		return cc->ops->pacing_rate(cc);
+	if (cc->srtt == 0)
+		return 0;
+	return (cc->cwnd < cc->ssthresh ? CC_PACE_SS : CC_PACE_CA) * cc->cwnd / cc->srtt;
+}
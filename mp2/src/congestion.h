@@ -0,0 +1,68 @@
+/*
+ * File:   congestion.h
+ *
+ * Pluggable congestion control for the reliable sender.  A controller
+ * keeps the congestion window in segments and is driven by three
+ * hooks: a segment newly acknowledged, a loss (at most one per window
+ * of data), and an RTT sample.  An acknowledged segment comes with
+ * when it was sent and how many segments had been acknowledged then,
+ * which gives the rate data was delivered at meanwhile.  A sender that
+ * paces asks for the rate to spread the window over; a controller
+ * without its own sends the window once per smoothed RTT.
+ */
+
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <stdint.h>
+
+#define CC_INIT_CWND	10		// segments, as with TCP's initial window
+#define CC_BW_ROUNDS	10		// rounds the BBR-style bandwidth filter spans
+#define CC_PACE_SS		2		// pacing gain over cwnd/RTT in slow start
+#define CC_PACE_CA		1.2		// and after it
+
+typedef struct cc cc_t;
+
+typedef struct {
+	const char* name;
+	void (*init)(cc_t* cc, uint64_t now);
+	void (*on_ack)(cc_t* cc, uint64_t now, uint64_t sent, long delivered);
+	void (*on_loss)(cc_t* cc, uint64_t now);
+	void (*on_rtt)(cc_t* cc, uint64_t rtt, uint64_t now);
+	double (*pacing_rate)(cc_t* cc);
+} cc_ops_t;
+
+struct cc {
+	const cc_ops_t* ops;
+	double cwnd;						// congestion window, segments
+	double ssthresh;					// slow start threshold, segments
+	double max_cwnd;					// most the sender can keep in flight
+	uint64_t srtt;						// smoothed RTT, usec
+	uint64_t min_rtt;					// lowest RTT seen, usec
+	long acked;							// segments acknowledged so far
+	long losses;						// loss events so far
+	// CUBIC
+	double w_max;						// window at the last loss
+	double k;							// time to climb back to w_max, sec
+	uint64_t epoch_start;				// start of the current growth epoch, 0 for none
+	// BBR-style
+	int mode;							// STARTUP, DRAIN or PROBE_BW
+	double btl_bw;						// bottleneck bandwidth, segments per usec
+	double bw_samples[CC_BW_ROUNDS];	// delivery rate of the last rounds
+	long round;							// rounds completed
+	long round_end;						// a segment sent with this many acked ends the round
+	double round_bw;					// best delivery rate seen this round
+	double full_bw;						// bandwidth when startup last grew it
+	int full_bw_rounds;					// rounds since then
+	int cycle;							// position in the PROBE_BW gain cycle
+};
+
+int cc_select(cc_t* cc, const char* name);
+void cc_init(cc_t* cc, int max_cwnd, uint64_t now);
+void cc_ack(cc_t* cc, uint64_t now, uint64_t sent, long delivered);
+void cc_loss(cc_t* cc, uint64_t now);
+void cc_rtt(cc_t* cc, uint64_t rtt, uint64_t now);
+int cc_window(cc_t* cc);
+double cc_pacing_rate(cc_t* cc);
+
+#endif
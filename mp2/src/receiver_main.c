@@ -7,6 +7,7 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -14,28 +15,63 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-#define MAXBUFLEN   1472
-#define FRAMES     60000
+#include "batch_io.h"
+
+#define WINDOW     65536	// ring slots, as many as the sender's window can span
 #define DATA           0
 #define SYN            1
 #define SYN_ACK        2
 #define ACK            3
 #define FIN            4
 #define FIN_ACK        5
+#define DATA_LAST      6	// DATA that fills the window: ACK it at once
+#define RUN_MAX       64	// segments written by one pwritev()
+#define SACK_MAX       4	// SACK blocks an ACK carries
+#define ACK_DELAY    200	// usec an ACK may be held back for
 
-int NFE = 0, LFA = -1;
-uint8_t present[FRAMES];
-FILE * recv_file;
+int64_t NFE = 0, LFA = -1;
+// frames held at or after NFE, indexed by seq % WINDOW; a slot is
+// cleared when NFE passes it
+uint8_t present[WINDOW];
+int recv_fd;
+// segments of the current batch that follow on from each other in the
+// file, waiting to be written together; they point into rx_batch
+struct iovec run[RUN_MAX];
+int run_count = 0;
+off_t run_off, run_len;
+long segments_written = 0, writes = 0;
+// in-order segments to ACK together, 1 for an ACK per segment
+int ack_every = 16;
+// segments received since the last ACK
+int pending = 0;
+// datagrams per recvmmsg()/sendmmsg(), 1 for one syscall each
+int batch_size = BATCH_MAX;
+// take segments coalesced by GRO, send ACK runs as GSO super-packets
+int offload = 0;
+batch_t rx_batch, tx_batch;
 typedef struct {
 	uint64_t sent_time;    // sent time in microseconds for RTT calculations
-	uint16_t seq_no;       // sequence number for sender and expected sequence number for receiver
+	uint32_t seq_no;       // sequence number for sender and expected sequence number for receiver
 	uint16_t code;         // DATA, SYN, SYN_ACK, ACK, FIN
+	uint16_t sacks;        // SACK blocks following an ACK
 } TCP_header;
 
+// frames [start, end) held beyond the cumulative ACK
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+} SACK_block;
+
+// what is held beyond NFE, most recently grown block first
+SACK_block sack[SACK_MAX];
+int sack_count = 0;
+
 
 uint64_t htonll(uint64_t host_longlong) {
     int x = 1;
@@ -58,11 +94,99 @@ uint64_t ntohll(uint64_t host_longlong) {
 }
 
 void print_header(TCP_header * header) {
-	printf("Seq_no = %d \n", ntohs(header->seq_no));
+	printf("Seq_no = %u \n", ntohl(header->seq_no));
 	printf("Code = %d \n", ntohs(header->code));
 	printf("Sent time = %llu\n", (unsigned long long) ntohll(header->sent_time));
 }
 
+// write out the pending run of segments
+void flush_run() {
+	if (run_count == 0)
+		return;
+	if (pwritev(recv_fd, run, run_count, run_off) != run_len) {
+		perror("receiver: pwritev");
+		exit(1);
+	}
+	writes++;
+	run_count = 0;
+	run_len = 0;
+}
+
+// write a segment at its offset, along with its neighbours if they
+// arrived in order; it must be flushed before its batch is reused
+void write_segment(char* data, int len, off_t off) {
+	if (run_count == RUN_MAX || (run_count > 0 && off != run_off + run_len))
+		flush_run();
+	if (run_count == 0)
+		run_off = off;
+	run[run_count].iov_base = data;
+	run[run_count].iov_len = len;
+	run_count++;
+	run_len += len;
+	segments_written++;
+}
+
+// add frame seq, beyond NFE, to the SACK blocks: it joins whatever
+// blocks it touches and the result moves to the front
+void sack_add(uint32_t seq) {
+	SACK_block b = { seq, seq + 1 }, kept[SACK_MAX];
+	int i, n = 0;
+	for (i = 0; i < sack_count; i++) {
+		if (sack[i].start <= b.end && sack[i].end >= b.start) {
+			if (sack[i].start < b.start)
+				b.start = sack[i].start;
+			if (sack[i].end > b.end)
+				b.end = sack[i].end;
+		} else {
+			kept[n++] = sack[i];
+		}
+	}
+	sack[0] = b;
+	if (n > SACK_MAX - 1)
+		n = SACK_MAX - 1;
+	memcpy(&sack[1], kept, n * sizeof(SACK_block));
+	sack_count = n + 1;
+}
+
+// drop the blocks NFE has caught up with
+void sack_trim() {
+	int i, n = 0;
+	for (i = 0; i < sack_count; i++) {
+		if (sack[i].end > NFE)
+			sack[n++] = sack[i];
+	}
+	sack_count = n;
+}
+
+// queue an ACK of everything before NFE plus the SACK blocks, echoing
+// the sent time of the segment that prompted it
+void queue_ack(int sockfd, uint64_t echo) {
+	TCP_header ack;
+	char* dgram = batch_slot(&tx_batch);
+	ack.sent_time = echo;
+	ack.seq_no = NFE;
+	ack.code = ACK;
+	ack.sacks = sack_count;
+	memcpy(dgram, &ack, sizeof(ack));
+	memcpy(dgram + sizeof(ack), sack, sack_count * sizeof(SACK_block));
+	batch_push(&tx_batch, sockfd, sizeof(ack) + sack_count * sizeof(SACK_block));
+	pending = 0;
+}
+
+// hold the socket's receive timeout at ACK_DELAY while an ACK is
+// pending, so a held back ACK still goes out if no more data comes
+void set_ack_timer(int sockfd, int on) {
+	static int armed = 0;
+	struct timeval tv;
+	if (on == armed)
+		return;
+	tv.tv_sec = 0;
+	tv.tv_usec = on ? ACK_DELAY : 0;
+	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+		perror("receiver: setsockopt");
+	armed = on;
+}
+
 int reliablyReceive(char * udpPort, char* destinationFile) {
 	int sockfd, rv, numbytes, i;
 	struct addrinfo hints, *servinfo, *p;
@@ -106,6 +230,12 @@ int reliablyReceive(char * udpPort, char* destinationFile) {
     numbytes = recvfrom(sockfd, buf, MAXBUFLEN , 0, (struct sockaddr*)&their_addr, &their_addr_len);
 
     memcpy(&header, buf, TCP_size);
+    // the size the sender announced, 0 if it did not
+    uint64_t file_size = 0;
+    if (numbytes >= TCP_size + (int)sizeof(file_size)) {
+    	memcpy(&file_size, buf + TCP_size, sizeof(file_size));
+    	file_size = ntohll(file_size);
+    }
     header.code = SYN_ACK;
 	while(1) {
 		memcpy(buf, &header, TCP_size);
@@ -124,43 +254,85 @@ int reliablyReceive(char * udpPort, char* destinationFile) {
 
 
 	int data_len = MAXBUFLEN - TCP_size;
-	recv_file = fopen(destinationFile, "wb");
+	recv_fd = open(destinationFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (recv_fd < 0) {
+		perror("receiver: open");
+		exit(1);
+	}
+	// reserve the whole file up front so out of order writes never
+	// extend it; pwrite() copes without if the file system cannot
+	if (file_size > 0 && fallocate(recv_fd, 0, 0, file_size) < 0)
+		perror("receiver: fallocate");
 	printf("Recieving File...\n");
-	uint16_t code, seq, length;
-	while(1) {
-		numbytes = recvfrom(sockfd, buf, MAXBUFLEN, 0, NULL, NULL);
-		if (numbytes < TCP_size)
+	uint16_t code, length;
+	int64_t seq, old_NFE;
+	uint64_t echo = 0;
+	int done = 0;
+	char* dgram;
+	batch_init(&rx_batch, sockfd, batch_size, offload, NULL, 0);
+	batch_init(&tx_batch, sockfd, batch_size, offload, (struct sockaddr*)&their_addr, their_addr_len);
+	while(!done) {
+		set_ack_timer(sockfd, pending > 0);
+		if (batch_recv(&rx_batch, sockfd) == 0) {
+			// the delayed ACK timer ran out
+			if (pending > 0)
+				queue_ack(sockfd, echo);
+			batch_flush(&tx_batch, sockfd);
 			continue;
-		memcpy(&header, buf, TCP_size);
-		code = header.code;
-		if (code == FIN)
-			break;
-		if (code != DATA)
-			continue;
-		seq = header.seq_no;
-		length = numbytes - TCP_size;
-		if(present[seq] == 0) {
-			present[seq] = 1;
-			if (SEEK_CUR != seq * data_len)
-				fseek(recv_file, seq * data_len, SEEK_SET);
-			fwrite(buf + TCP_size, 1, length, recv_file);
-			while(present[NFE])
-				NFE++;
 		}
+		while((numbytes = batch_next(&rx_batch, &dgram)) >= 0) {
+			if (numbytes < TCP_size)
+				continue;
+			memcpy(&header, dgram, TCP_size);
+			code = header.code;
+			if (code == FIN) {
+				done = 1;
+				break;
+			}
+			if (code != DATA && code != DATA_LAST)
+				continue;
+			seq = header.seq_no;
+			length = numbytes - TCP_size;
+			// no room to remember a frame that far ahead; it comes again
+			if (seq >= NFE + WINDOW)
+				continue;
+			// frames before NFE are already written
+			old_NFE = NFE;
+			if(seq >= NFE && present[seq % WINDOW] == 0) {
+				present[seq % WINDOW] = 1;
+				write_segment(dgram + TCP_size, length, (off_t)seq * data_len);
+				while(present[NFE % WINDOW]) {
+					present[NFE % WINDOW] = 0;
+					NFE++;
+				}
+				if (seq > NFE)
+					sack_add(seq);
+				else
+					sack_trim();
+			}
 
-        header.code = ACK;
-		memcpy(buf, &header, TCP_size);
-		if ((numbytes = sendto(sockfd, buf, TCP_size, 0, (struct sockaddr *)&their_addr, their_addr_len)) == -1) {
-			perror("receiver: sendto");
-			exit(2);
+			// in-order segments are ACKed every ack_every or when the
+			// timer runs out; anything out of order, repeated or filling
+			// a hole is ACKed at once so the sender sees the gap, and so
+			// is the segment that fills the sender's window
+			echo = header.sent_time;
+			pending++;
+			if (code == DATA_LAST || seq != old_NFE || NFE > old_NFE + 1 || pending >= ack_every)
+				queue_ack(sockfd, echo);
+			if(seq > LFA)
+				LFA = seq;
 		}
-		if(seq > LFA)
-			LFA = seq;
+		flush_run();
+		batch_flush(&tx_batch, sockfd);
 	}
 
 	header.code = FIN_ACK;
 	memcpy(buf, &header, TCP_size);
 	printf("Connection closed by sender\n");
+	printf("Transfer: %ld segments in %ld messages (GRO %s), %ld ACKs in %ld messages (GSO %s)\n",
+		rx_batch.datagrams, rx_batch.messages, rx_batch.offload ? "on" : "off",
+		tx_batch.datagrams, tx_batch.messages, tx_batch.offload ? "on" : "off");
+	printf("Wrote %ld segments in %ld writes\n", segments_written, writes);
 	for(i = 0; i < 5; i++) {
 		if ((numbytes = sendto(sockfd, buf, TCP_size, 0, (struct sockaddr *)&their_addr, their_addr_len)) == -1) {
 			perror("receiver: sendto");
@@ -168,15 +340,32 @@ int reliablyReceive(char * udpPort, char* destinationFile) {
 		}
 	}
 
-	fclose(recv_file);
+	// one sync for the whole file, after the sender has its FIN_ACK
+	if (fdatasync(recv_fd) < 0)
+		perror("receiver: fdatasync");
+	close(recv_fd);
 	close(sockfd);
 }
 
 int main(int argc, char** argv) {
-	if(argc != 3) {
-		fprintf(stderr, "usage: %s UDP_port filename_to_write\n\n", argv[0]);
+	int i;
+
+	// options come before the usual arguments
+	for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+		if (strncmp(argv[i], "--batch=", 8) == 0)
+			batch_size = atoi(argv[i] + 8);
+		else if (strcmp(argv[i], "--offload") == 0)
+			offload = 1;
+		else if (strncmp(argv[i], "--ack-every=", 12) == 0)
+			ack_every = atoi(argv[i] + 12);
+		else
+			break;
+	}
+
+	if(argc - i != 2 || batch_size < 1 || batch_size > BATCH_MAX || ack_every < 1) {
+		fprintf(stderr, "usage: %s [--batch=1..%d] [--offload] [--ack-every=N] UDP_port filename_to_write\n\n", argv[0], BATCH_MAX);
 		exit(1);
 	}
-    
-	reliablyReceive(argv[1], argv[2]);
+
+	reliablyReceive(argv[i], argv[i + 1]);
 }
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
@@ -16,29 +17,94 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
-#define MAXBUFLEN	1472
-#define FRAMES 	   60000
+#include "batch_io.h"
+#include "congestion.h"
+#include "timer_wheel.h"
+
+#define WINDOW 	   65536	// ring slots, a power of two above any SWS
 #define DATA 		   0
 #define SYN 		   1
 #define SYN_ACK        2
 #define ACK            3
 #define FIN            4
 #define FIN_ACK 	   5
+#define DATA_LAST      6	// DATA that fills the window: ACK it at once
+#define ACK_DELAY    200	// usec the receiver may hold an ACK back for
+#define WHEEL_TICK   100	// usec per retransmission timer wheel slot
+#define DUP_THRESH     3	// frames SACKed beyond a hole that make it lost
+#define SENT_END   WINDOW	// head and tail of the transmission order list
+#define PACE_SPIN     50	// usec: a pacing gap this short is spun, not slept
 
 int64_t timeOut, estimatedRTT = 1000, deviation = 1, difference = 0;
-int LAR = -1; 	// last acknowlegement received
-int LFS = -1; 	// last frame sent
+int64_t LAR = -1; 	// last acknowlegement received
+int64_t LFS = -1; 	// last frame sent
 int SWS = 0; 	// sender window size
-uint8_t ACKed[FRAMES];
-uint8_t sent[FRAMES];
+// per-segment state of the window, indexed by seq % WINDOW; a slot is
+// cleared when LAR passes it so it can be reused WINDOW frames later
+uint8_t ACKed[WINDOW];
+uint64_t sentTime[WINDOW];
+long sentDelivered[WINDOW];	// segments acked when the frame was last sent
+// datagrams per sendmmsg()/recvmmsg(), 1 for one syscall each
+int batch_size = BATCH_MAX;
+// send runs of segments as GSO super-packets, take ACKs coalesced by GRO
+int offload = 0;
+// send segments straight out of the mapped file instead of fread()
+int use_mmap = 0;
+batch_t tx_batch, rx_batch;
+// congestion controller sizing the window, chosen with --cc
+cc_t cc;
+// retransmission deadline of every frame in flight, by seq % WINDOW
+wheel_timer_t rtx_timer[WINDOW];
+wheel_t wheel;
+// frames in flight in the order they were last sent, oldest first,
+// linked by seq % WINDOW through sentNext/sentPrev; -1 if not listed
+int sentNext[WINDOW + 1], sentPrev[WINDOW + 1];
+// RACK: the delivered frame sent last, and the RTT it took; a frame
+// sent before it and older than that RTT plus a little is lost
+uint64_t rack_xmit = 0, rack_rtt = 0;
+int64_t rack_seq = -1;
+int64_t high_sacked = -1;	// highest frame the receiver holds
+wheel_timer_t rack_timer;	// when the oldest frame may become lost
+int64_t recover = -1;	// frames up to here were sent before the last loss
+int fast_retransmits = 0, timeout_retransmits = 0;
+// spread frames at the controller's pacing rate instead of sending the
+// window back to back, chosen with --pace
+int pacing = 0;
+double pace_next = 0;		// usec: when the schedule lets the next frame go
+double pace_target = 0;		// usec the schedule gave the frames paced so far
+long pace_frames = 0;
+long pace_holds = 0, pace_spins = 0;
+// frames sent and over what time, for the rate achieved
+uint64_t first_sent = 0, last_sent = 0;
+long data_sent = 0;
 
 typedef struct {
 	uint64_t sent_time; 	// sent time in microseconds for RTT calculations
-	uint16_t seq_no; 		// sequence number for sender and expected sequence number for receiver
+	uint32_t seq_no; 		// sequence number for sender and expected sequence number for receiver
 	uint16_t code;   		// DATA, SYN, SYN_ACK, ACK, FIN
+	uint16_t sacks;			// SACK blocks following an ACK
 } TCP_header;
 
+// frames [start, end) the receiver holds beyond its cumulative ACK
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+} SACK_block;
+
+// where segments come from: the mapped file, or fread() from out_file
+TCP_header my_header;
+FILE* out_file;
+char* file_map;
+int64_t file_seg = 0;	// segment fread() is positioned at
+int64_t segments;
+int data_len, final_seg_size;
+
 uint64_t htonll(uint64_t host_longlong) {
     int x = 1;
     /* little endian */
@@ -60,7 +126,7 @@ uint64_t ntohll(uint64_t host_longlong) {
 }
 
 void print_header(TCP_header * header) {
-	printf("Seq_no = %d \n", ntohs(header->seq_no));
+	printf("Seq_no = %u \n", ntohl(header->seq_no));
 	printf("Code = %d \n", ntohs(header->code));
 	printf("Sent time = %llu\n", (unsigned long long) ntohll(header->sent_time));
 }
@@ -69,18 +135,22 @@ int set_timeout(int sockfd, int usec) {
 	if (usec < 0)
 		return -1;
 	struct timeval tv;
-	tv.tv_sec = 0;
-	tv.tv_usec = usec;
+	// a zero timeout would block forever
+	if (usec == 0)
+		usec = 1;
+	tv.tv_sec = usec / 1000000;
+	tv.tv_usec = usec % 1000000;
 	if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
     	perror("sender: setsockopt");
 	}
 	return 0;
 }
 
+// monotonic microseconds, the clock the retransmission timerfd runs on
 uint64_t time_now() {
-	struct timeval current;
-	gettimeofday(&current, 0);
-	return (current.tv_sec * 1000000 + current.tv_usec);
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (current.tv_sec * 1000000 + current.tv_nsec / 1000);
 }
 
 void update_timeout(uint64_t sentTime) {
@@ -89,10 +159,198 @@ void update_timeout(uint64_t sentTime) {
 	deviation += (0.25 * (abs(sampleRTT - estimatedRTT) - deviation)); // delta = 0.25
 	timeOut = (estimatedRTT + 4 * deviation);
 	timeOut = timeOut / 5;
+	cc_rtt(&cc, sampleRTT, sentTime + sampleRTT);
+}
+
+// retransmission timeout, usec: RTT samples only time the frame that
+// prompted each ACK, so allow for a frame having waited out a delayed
+// ACK on top of the RTT, as TCP's minimum RTO does
+int64_t rto() {
+	return timeOut * 5 + ACK_DELAY;
+}
+
+// map the bytes to send, read in order; NULL if they cannot be mapped
+// and segments have to be read with fread() instead
+char* map_file(FILE* file, unsigned long long int bytes) {
+	struct stat st;
+	void* map;
+	if (file == NULL || bytes == 0)
+		return NULL;
+	if (fstat(fileno(file), &st) < 0 || (unsigned long long int)st.st_size < bytes) {
+		fprintf(stderr, "sender: file shorter than %llu bytes, not mapping it\n", bytes);
+		return NULL;
+	}
+	map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED) {
+		perror("sender: mmap");
+		return NULL;
+	}
+	madvise(map, bytes, MADV_SEQUENTIAL);
+	return map;
 }
 
-uint16_t win_size() {
-	return 50 * timeOut / MAXBUFLEN;  // (100/8) MBps * timeOut (usec) / MAXBUFLEN
+// the frame in flight using ring slot
+int64_t slot_seq(int slot) {
+	return LAR + 1 + ((slot - (LAR + 1)) & (WINDOW - 1));
+}
+
+// take frame slot out of the transmission order list
+void sent_unlink(int slot) {
+	if (sentPrev[slot] < 0)
+		return;
+	sentNext[sentPrev[slot]] = sentNext[slot];
+	sentPrev[sentNext[slot]] = sentPrev[slot];
+	sentNext[slot] = sentPrev[slot] = -1;
+}
+
+// put frame slot last in the transmission order list
+void sent_append(int slot) {
+	sent_unlink(slot);
+	sentPrev[slot] = sentPrev[SENT_END];
+	sentNext[slot] = SENT_END;
+	sentNext[sentPrev[SENT_END]] = slot;
+	sentPrev[SENT_END] = slot;
+}
+
+// mark frames [from, to) of the window acknowledged by an ACK echoing
+// the sent time echo.  A frame last sent after the echoed one, or
+// sooner ago than any RTT seen, may have been delivered by an earlier
+// copy, so it gives no RTT or delivery rate (RFC 8985, 6.2 step 2).
+void ack_range(int64_t from, int64_t to, uint64_t now, uint64_t echo) {
+	int64_t seq;
+	int slot;
+	uint64_t sent;
+	if (from < LAR + 1)
+		from = LAR + 1;
+	if (to > LFS + 1)
+		to = LFS + 1;
+	for (seq = from; seq < to; seq++) {
+		slot = seq % WINDOW;
+		if (ACKed[slot] == 0) {
+			ACKed[slot] = 1;
+			wheel_cancel(&wheel, &rtx_timer[slot]);
+			sent_unlink(slot);
+			sent = sentTime[slot];
+			if (sent > echo || now - sent < cc.min_rtt)
+				sent = 0;
+			cc_ack(&cc, now, sent, sentDelivered[slot]);
+			if (sent != 0 && (sent > rack_xmit || (sent == rack_xmit && seq > rack_seq))) {
+				rack_xmit = sent;
+				rack_seq = seq;
+				rack_rtt = now - sent;
+			}
+			if (seq > high_sacked)
+				high_sacked = seq;
+		}
+	}
+}
+
+// a frame goes out at now: move the pacing schedule one frame on.  An
+// idle sender earns no credit, so the schedule never lets a burst out.
+void pace_sent(uint64_t now) {
+	double rate = cc_pacing_rate(&cc);
+	if (first_sent == 0)
+		first_sent = now;
+	last_sent = now;
+	data_sent++;
+	if (!pacing || rate <= 0)
+		return;
+	if (pace_next < now)
+		pace_next = now;
+	pace_next += 1 / rate;
+	pace_target += 1 / rate;
+	pace_frames++;
+}
+
+// spin on the clock until the schedule lets the next frame go, for
+// gaps too short to sleep through without oversleeping; the frames
+// already due go out first
+void pace_spin(int sockfd, uint64_t* now) {
+	batch_flush(&tx_batch, sockfd);
+	pace_spins++;
+	while ((*now = time_now()) < pace_next)
+		;
+}
+
+// queue frame seq and start its retransmission timer
+void send_segment(int sockfd, int64_t seq, uint64_t now) {
+	int slot = seq % WINDOW;
+	uint16_t length;
+	char* dgram = batch_slot(&tx_batch);
+	sentTime[slot] = now;
+	sentDelivered[slot] = cc.acked;
+	my_header.seq_no = seq;
+	// nothing more can go out until this one is ACKed
+	my_header.code = seq == LAR + SWS || seq == segments - 1 ? DATA_LAST : DATA;
+	my_header.sent_time = now;
+	memcpy(dgram, &my_header, sizeof(my_header));
+	if (seq == segments - 1 && final_seg_size > 0)
+		length = final_seg_size;
+	else
+		length = data_len;
+	if (file_map != NULL) {
+		// the payload goes out of the mapping, retransmits included
+		batch_push_data(&tx_batch, sockfd, sizeof(my_header), file_map + (off_t)data_len * seq, length);
+	} else {
+		if (file_seg != seq)
+			fseeko(out_file, (off_t)data_len * seq, SEEK_SET);
+		fread(dgram + sizeof(my_header), 1, length, out_file);
+		file_seg = seq + 1;
+		batch_push(&tx_batch, sockfd, sizeof(my_header) + length);
+	}
+	wheel_add(&wheel, &rtx_timer[slot], now + rto());
+	sent_append(slot);
+	pace_sent(now);
+	if (LFS < seq)
+		LFS = seq;
+}
+
+// resend a lost frame; the first loss of a window tells the congestion
+// controller, the rest were sent into the same congestion
+void retransmit(int sockfd, int64_t seq, uint64_t now) {
+	if (seq > recover) {
+		cc_loss(&cc, now);
+		recover = LFS;
+	}
+	send_segment(sockfd, seq, now);
+}
+
+// resend every frame that is lost by now: sent before the last frame
+// delivered, and either DUP_THRESH frames beyond it have arrived (fast
+// retransmit) or it has been out longer than that frame's RTT plus a
+// reordering window (RACK).  The list is in sending order, so the
+// first frame not lost yet ends the walk and sets the RACK timer.
+void detect_losses(int sockfd, uint64_t now) {
+	uint64_t reo_wnd = cc.min_rtt / 4;
+	int slot;
+	int64_t seq;
+	while ((slot = sentNext[SENT_END]) != SENT_END) {
+		seq = slot_seq(slot);
+		if (sentTime[slot] >= now || sentTime[slot] > rack_xmit
+		    || (sentTime[slot] == rack_xmit && seq >= rack_seq))
+			return;
+		if (seq + DUP_THRESH > high_sacked && sentTime[slot] + rack_rtt + reo_wnd > now) {
+			wheel_add(&wheel, &rack_timer, sentTime[slot] + rack_rtt + reo_wnd);
+			return;
+		}
+		fast_retransmits++;
+		retransmit(sockfd, seq, now);
+	}
+}
+
+// have the timerfd go off at deadline, unless it already will
+void arm_timer(int tfd, uint64_t deadline, uint64_t* armed) {
+	struct itimerspec its;
+	if (deadline == 0 || deadline == *armed)
+		return;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / 1000000;
+	its.it_value.tv_nsec = deadline % 1000000 * 1000;
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		perror("sender: timerfd_settime");
+		exit(1);
+	}
+	*armed = deadline;
 }
 
 int reliablyTransfer(char* hostname, char* udpPort, char* filename, unsigned long long int bytesToTransfer) {
@@ -150,15 +408,19 @@ int reliablyTransfer(char* hostname, char* udpPort, char* filename, unsigned lon
 		exit(1);
 	}
 
-	TCP_header my_header, their_header;
+	TCP_header their_header;
 	int TCP_size = (int)sizeof(my_header);
+	// the SYN announces the transfer size after its header
+	uint64_t announced = htonll(bytesToTransfer);
 	my_header.seq_no = 0;
 	my_header.code = SYN;
+	my_header.sacks = 0;
 	printf("Starting three way handshake...\n");
 	while(1) {
 		my_header.sent_time = time_now();
 		memcpy(buf, &my_header, TCP_size);
-		if (numbytes = sendto(sockfd, buf, TCP_size, 0, (struct sockaddr*)&sendto_addr, sizeof(sendto_addr)) == -1) {
+		memcpy(buf + TCP_size, &announced, sizeof(announced));
+		if ((numbytes = sendto(sockfd, buf, TCP_size + sizeof(announced), 0, (struct sockaddr*)&sendto_addr, sizeof(sendto_addr))) == -1) {
 			perror("sender: sendto");
 			exit(1);
 		}
@@ -178,87 +440,142 @@ int reliablyTransfer(char* hostname, char* udpPort, char* filename, unsigned lon
 	}
 	printf("Connection Established\n");
 
-	int data_len = MAXBUFLEN - TCP_size;
-	int segments = bytesToTransfer / data_len;
-	int final_seg_size = bytesToTransfer % data_len;
+	data_len = MAXBUFLEN - TCP_size;
+	segments = bytesToTransfer / data_len;
+	final_seg_size = bytesToTransfer % data_len;
 
 	if (final_seg_size > 0)
 		segments++;
+	if (segments > UINT32_MAX) {
+		fprintf(stderr, "sender: file too large for 32-bit sequence numbers\n");
+		exit(1);
+	}
 
-	SWS = win_size();
-	printf("SWS %d\n", SWS);
+	cc_init(&cc, WINDOW, time_now());
+	SWS = cc_window(&cc);
+	printf("Congestion control %s, SWS %d\n", cc.ops->name, SWS);
 
 	my_header.code = DATA;
-	FILE* out_file = fopen(filename, "rb");
-	int double_sent = 0;
+	out_file = fopen(filename, "rb");
+	file_map = use_mmap ? map_file(out_file, bytesToTransfer) : NULL;
 	printf("Sending File...\n");
 
-	int slow_start = 0;
-	uint16_t seq, length;
-	int last_LFS = -1;
-	int flag = 2;
-	uint64_t sentTime[FRAMES] = {0};
-	uint64_t currTime = 0;
+	int slot, n, readable, held;
+	uint64_t currTime = 0, expirations, armed = 0, deadline, round_start;
+	char* dgram;
+	SACK_block block;
+	wheel_timer_t* timer;
+	struct epoll_event ev, events[2];
+
+	batch_init(&tx_batch, sockfd, batch_size, offload, (struct sockaddr*)&sendto_addr, sizeof(sendto_addr));
+	batch_init(&rx_batch, sockfd, batch_size, offload, NULL, 0);
+
+	// sleep until an ACK arrives or the next retransmission timer is due
+	int epfd = epoll_create1(0);
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (epfd < 0 || tfd < 0) {
+		perror("sender: epoll/timerfd");
+		exit(1);
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = sockfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev);
+	ev.data.fd = tfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+	wheel_init(&wheel, WHEEL_TICK, time_now());
+	sentNext[SENT_END] = sentPrev[SENT_END] = SENT_END;
+	for (i = 0; i < WINDOW; i++)
+		sentNext[i] = sentPrev[i] = -1;
 
 	while(LAR != segments - 1) {
-		if (slow_start < 30) {
-			SWS = (SWS)/flag;
-			slow_start++;
-			flag = 3;
+		// new frames, as far as the window reaches and the pacing
+		// schedule lets them; spin no longer than PACE_SPIN before
+		// looking at the ACKs again
+		currTime = round_start = time_now();
+		held = 0;
+		while (LFS + 1 < segments && LFS + 1 <= LAR + SWS) {
+			if (pacing && pace_next > currTime) {
+				if (pace_next > round_start + PACE_SPIN) {
+					held = 1;
+					break;
+				}
+				pace_spin(sockfd, &currTime);
+			}
+			send_segment(sockfd, LFS + 1, currTime);
+		}
+		batch_flush(&tx_batch, sockfd);
+
+		// wake for the next frame the schedule holds back early enough
+		// to spin out the rest of its gap
+		deadline = wheel_next(&wheel);
+		if (held) {
+			pace_holds++;
+			if (deadline == 0 || pace_next - PACE_SPIN < deadline)
+				deadline = pace_next - PACE_SPIN;
+		}
+		arm_timer(tfd, deadline, &armed);
+		n = epoll_wait(epfd, events, 2, -1);
+		readable = 0;
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == tfd) {
+				read(tfd, &expirations, sizeof(expirations));
+				armed = 0;
+			} else {
+				readable = 1;
+			}
 		}
-		for (i = 0; i < SWS; i++) {
-			seq = LAR+1+i;
-			currTime = time_now();
-			if (currTime - sentTime[seq] < timeOut * 5)
+
+		// take the ACKs that are in and refill the window as soon as
+		// they open it; with one waiting the receive does not block,
+		// and without, the last batch has been read to the end
+		if (readable)
+			batch_recv(&rx_batch, sockfd);
+		while((numbytes = batch_next(&rx_batch, &dgram)) >= 0) {
+			if (numbytes < TCP_size)
 				continue;
-			if(ACKed[seq] == 0 && seq < segments) {
-				if (sent[seq] == 1)
-					double_sent++;
-				sent[seq] = 1;
-				my_header.seq_no = seq;
-				my_header.sent_time = currTime;
-				memcpy(buf, &my_header, TCP_size);
-				if (SEEK_CUR != seq * data_len)
-					fseek(out_file, data_len * seq, SEEK_SET);
-				if (seq == segments - 1 && final_seg_size > 0)
-					length = final_seg_size;
-				else
-					length = data_len;
-				fread(buf + TCP_size, 1, length, out_file);
-				if (numbytes = sendto(sockfd, buf, length + TCP_size, 0, (struct sockaddr*)&sendto_addr, sizeof(sendto_addr)) == -1) {
-					perror("sender: sendto");
-					exit(1);
+			memcpy(&their_header, dgram, TCP_size);
+			// everything before the cumulative ACK has arrived, and so
+			// has every frame in the SACK blocks after it
+			if (their_header.code == ACK) {
+				currTime = time_now();
+				ack_range(LAR + 1, their_header.seq_no, currTime, their_header.sent_time);
+				for (i = 0; i < their_header.sacks && TCP_size + (i + 1) * (int)sizeof(block) <= numbytes; i++) {
+					memcpy(&block, dgram + TCP_size + i * sizeof(block), sizeof(block));
+					ack_range(block.start, block.end, currTime, their_header.sent_time);
 				}
-				if (LFS < seq)
-					LFS = seq;
 			}
-			if (last_LFS == LFS)
-				set_timeout(sockfd, timeOut * 2);
-			last_LFS = LFS;
+			update_timeout(their_header.sent_time);
 		}
-		while(1) {
-			numbytes = recvfrom(sockfd, buf, MAXBUFLEN, 0, &their_addr, &their_addr_len);
-			if(numbytes == TCP_size) {
-				memcpy(&their_header, buf, TCP_size);
-				if (their_header.code == ACK)
-					ACKed[their_header.seq_no] = 1;
-				update_timeout(their_header.sent_time);
-			}
-			else {
-				break;
+
+		// resend the frames whose timers ran out, then whatever the
+		// ACKs show to be lost; the RACK timer only prompts the latter
+		currTime = time_now();
+		while ((timer = wheel_expire(&wheel, currTime)) != NULL) {
+			if (timer == &rack_timer)
+				continue;
+			slot = timer - rtx_timer;
+			// the timeout may have grown since the frame was sent
+			if (currTime - sentTime[slot] < rto()) {
+				wheel_add(&wheel, timer, sentTime[slot] + rto());
+				continue;
 			}
+			timeout_retransmits++;
+			retransmit(sockfd, slot_seq(slot), currTime);
 		}
+		detect_losses(sockfd, currTime);
 
-		set_timeout(sockfd, timeOut);
-		i = LAR;
-		i++;
-		while(ACKed[i])
-			i++;
-		LAR = i-1;
-		SWS =win_size();
-		if (SWS > 1000)
-			SWS = 500;
+		while(LAR < LFS && ACKed[(LAR + 1) % WINDOW]) {
+			LAR++;
+			slot = LAR % WINDOW;
+			ACKed[slot] = 0;
+			sentTime[slot] = 0;
+		}
+		SWS = cc_window(&cc);
 	}
+	batch_flush(&tx_batch, sockfd);
+	set_timeout(sockfd, timeOut);
+	close(tfd);
+	close(epfd);
 
 	printf("Closing connection...  \n");
 	while(their_header.code != FIN_ACK) {
@@ -268,28 +585,69 @@ int reliablyTransfer(char* hostname, char* udpPort, char* filename, unsigned lon
 			perror("sender: sendto");
 			exit(1);
 		}
-		numbytes = recvfrom(sockfd, buf, MAXBUFLEN, 0, &their_addr, &their_addr_len);
-		if(numbytes == TCP_size)
-			memcpy(&their_header, buf, TCP_size);
+		// a FIN_ACK may come coalesced with late ACKs
+		batch_recv(&rx_batch, sockfd);
+		while((numbytes = batch_next(&rx_batch, &dgram)) >= 0) {
+			if(numbytes != TCP_size)
+				continue;
+			memcpy(&their_header, dgram, TCP_size);
+			if (their_header.code == FIN_ACK)
+				break;
+		}
 	}
 
 	printf("Connection closed \n");
 	double timeTaken = (time_now() - startTime) / 1000000.0;
 	printf("Time taken %f sec\n", timeTaken);
-	printf("double sent %d\n", double_sent);
-
+	printf("double sent %d: %d fast/RACK, %d on timeout\n", fast_retransmits + timeout_retransmits,
+		fast_retransmits, timeout_retransmits);
+	printf("Congestion control %s: %ld segments acked, %ld loss events, final window %d, min RTT %llu usec\n",
+		cc.ops->name, cc.acked, cc.losses, cc_window(&cc), (unsigned long long)cc.min_rtt);
+	if (pacing && pace_target > 0)
+		printf("Pacing: target %.1f Mbit/s, achieved %.1f Mbit/s, held %ld times, spun %ld gaps\n",
+			pace_frames * MAXBUFLEN * 8 / pace_target,
+			last_sent > first_sent ? data_sent * MAXBUFLEN * 8.0 / (last_sent - first_sent) : 0,
+			pace_holds, pace_spins);
+	printf("Transfer: %ld datagrams in %ld messages (GSO %s), %ld ACKs in %ld messages (GRO %s)\n",
+		tx_batch.datagrams, tx_batch.messages, tx_batch.offload ? "on" : "off",
+		rx_batch.datagrams, rx_batch.messages, rx_batch.offload ? "on" : "off");
+
+	if (file_map != NULL)
+		munmap(file_map, bytesToTransfer);
 	fclose(out_file);
 	close(sockfd);
 }
 
 int main(int argc, char** argv) {
 	unsigned long long int numBytes;
+	int i;
+
+	cc_select(&cc, "reno");
+	// options come before the usual arguments
+	for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+		if (strncmp(argv[i], "--batch=", 8) == 0)
+			batch_size = atoi(argv[i] + 8);
+		else if (strcmp(argv[i], "--offload") == 0)
+			offload = 1;
+		else if (strcmp(argv[i], "--mmap") == 0)
+			use_mmap = 1;
+		else if (strcmp(argv[i], "--pace") == 0)
+			pacing = 1;
+		else if (strncmp(argv[i], "--cc=", 5) == 0) {
+			if (!cc_select(&cc, argv[i] + 5)) {
+				fprintf(stderr, "unknown congestion control %s, use reno, cubic or bbr\n", argv[i] + 5);
+				exit(1);
+			}
+		}
+		else
+			break;
+	}
 
-	if(argc != 5) {
-		fprintf(stderr, "usage: %s receiver_hostname receiver_port filename_to_xfer bytes_to_xfer\n\n", argv[0]);
+	if(argc - i != 4 || batch_size < 1 || batch_size > BATCH_MAX) {
+		fprintf(stderr, "usage: %s [--batch=1..%d] [--offload] [--mmap] [--cc=reno|cubic|bbr] [--pace] receiver_hostname receiver_port filename_to_xfer bytes_to_xfer\n\n", argv[0], BATCH_MAX);
 		exit(1);
 	}
 
-	numBytes = atoll(argv[4]);
-	reliablyTransfer(argv[1], argv[2], argv[3], numBytes);
+	numBytes = atoll(argv[i + 3]);
+	reliablyTransfer(argv[i], argv[i + 1], argv[i + 2], numBytes);
 }
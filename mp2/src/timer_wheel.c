@@ -0,0 +1,88 @@
+/*
+ * File:   timer_wheel.c
+ *
+ * Hashed timer wheel for the sender's retransmission deadlines.
+ */
+
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define SLOT(tick)	((tick) & (WHEEL_SLOTS - 1))
+
+// an empty wheel that has expired everything up to now
+void wheel_init(wheel_t* wheel, uint64_t tick, uint64_t now) {
+	int i;
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->tick = tick;
+	wheel->current = now / tick;
+	for (i = 0; i < WHEEL_SLOTS; i++) {
+		wheel->slots[i].next = &wheel->slots[i];
+		wheel->slots[i].prev = &wheel->slots[i];
+	}
+}
+
+// arm timer for deadline, moving it if it is already armed; one
+// already due goes in the current slot
+void wheel_add(wheel_t* wheel, wheel_timer_t* timer, uint64_t deadline) {
+	uint64_t tick = deadline / wheel->tick;
+	wheel_timer_t* head;
+	wheel_cancel(wheel, timer);
+	if (tick < wheel->current)
+		tick = wheel->current;
+	head = &wheel->slots[SLOT(tick)];
+	timer->deadline = deadline;
+	timer->next = head->next;
+	timer->prev = head;
+	head->next->prev = timer;
+	head->next = timer;
+	wheel->count++;
+}
+
+// disarm timer; nothing happens if it is not armed
+void wheel_cancel(wheel_t* wheel, wheel_timer_t* timer) {
+	if (timer->prev == NULL)
+		return;
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->next = NULL;
+	timer->prev = NULL;
+	wheel->count--;
+}
+
+// disarm and return one timer that is due by now, NULL once there are
+// none; the wheel turns up to now as it looks
+wheel_timer_t* wheel_expire(wheel_t* wheel, uint64_t now) {
+	uint64_t now_tick = now / wheel->tick;
+	wheel_timer_t *head, *timer;
+	if (wheel->count == 0 && wheel->current < now_tick)
+		wheel->current = now_tick;
+	while (wheel->current <= now_tick) {
+		head = &wheel->slots[SLOT(wheel->current)];
+		for (timer = head->next; timer != head; timer = timer->next) {
+			if (timer->deadline <= now) {
+				wheel_cancel(wheel, timer);
+				return timer;
+			}
+		}
+		// the current slot can still gain timers due later this tick
+		if (wheel->current == now_tick)
+			break;
+		wheel->current++;
+	}
+	return NULL;
+}
+
+// when the next timer may be due, 0 if none is armed: the end of the
+// first slot ahead holding any timer, which may turn out to belong to
+// a later revolution
+uint64_t wheel_next(wheel_t* wheel) {
+	uint64_t tick;
+	if (wheel->count == 0)
+		return 0;
+	for (tick = wheel->current; tick < wheel->current + WHEEL_SLOTS; tick++) {
+		if (wheel->slots[SLOT(tick)].next != &wheel->slots[SLOT(tick)])
+			break;
+	}
+	return (tick + 1) * wheel->tick;
+}
@@ -0,0 +1,36 @@
+/*
+ * File:   timer_wheel.h
+ *
+ * Hashed timer wheel: a timer hangs in the slot its deadline falls in,
+ * WHEEL_SLOTS slots of one tick each, so arming and cancelling are
+ * O(1).  Deadlines more than a revolution away share a slot with
+ * nearer ones and are skipped until they are due.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define WHEEL_SLOTS		1024	// a power of two
+
+typedef struct wheel_timer {
+	struct wheel_timer* next;
+	struct wheel_timer* prev;			// NULL while not armed
+	uint64_t deadline;					// usec
+} wheel_timer_t;
+
+typedef struct {
+	uint64_t tick;						// usec per slot
+	uint64_t current;					// tick expired up to
+	int count;							// timers armed
+	wheel_timer_t slots[WHEEL_SLOTS];	// list heads
+} wheel_t;
+
+void wheel_init(wheel_t* wheel, uint64_t tick, uint64_t now);
+void wheel_add(wheel_t* wheel, wheel_timer_t* timer, uint64_t deadline);
+void wheel_cancel(wheel_t* wheel, wheel_timer_t* timer);
+wheel_timer_t* wheel_expire(wheel_t* wheel, uint64_t now);
+uint64_t wheel_next(wheel_t* wheel);
+
+#endif
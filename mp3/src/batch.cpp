@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+#include "linkstate.h"
+
+using namespace std;
+
+/**
+ * Batch Scenario Struct
+ *   One changes file run against the shared base topology.
+ */
+typedef struct scenario {
+    const char*     changes;    // changes file
+    string          output;     // output file written for it
+    int             epochs;     // table updates run
+    double          ms;         // wall time of the run
+} scenario_t;
+
+/**
+ * Run one scenario on the calling thread.  The thread's topology
+ * starts as a copy of the base map, so it points at the same nodes;
+ * apply_changes() copies a node the first time the scenario changes
+ * it, and only those copies are freed afterwards.
+ *
+ * @param base Parsed base topology, shared and never modified
+ * @param run  Scenario to run, filled with its results
+ */
+static void run_scenario(const map<int, node_t*>& base, scenario_t& run) {
+    auto start = chrono::steady_clock::now();
+
+    // scenarios already keep every core busy
+    int threads = engine_threads;
+    engine_threads = 1;
+    topology = base;
+    routing_table.clear();
+    changesfile.open(run.changes);
+    outfile.open(run.output);
+
+    run.epochs = run_epochs();
+
+    outfile.close();
+    changesfile.close();
+
+    for (auto p : topology) {
+        auto shared = base.find(p.first);
+        if (shared == base.end() || shared->second != p.second) {
+            delete p.second;
+        }
+    }
+    topology.clear();
+    routing_table.clear();
+    cache_clear();
+    engine_threads = threads;
+
+    run.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Run every changes file against the topology and messages already
+ * loaded by the calling thread, one scenario per pool task.  The
+ * output for changes file i (counting from 1) goes to output_i.txt.
+ * Per-message console output is muted since scenarios interleave.
+ *
+ * @param changes Changes files, one scenario each
+ * @return        0 once every scenario has finished
+ */
+int run_batch(vector<char*>& changes) {
+    auto start = chrono::steady_clock::now();
+
+    map<int, node_t*> base = topology;
+    base_topology = &base;
+
+    vector<scenario_t> runs(changes.size());
+    for (size_t i = 0; i < changes.size(); i++) {
+        runs[i].changes = changes[i];
+        runs[i].output = "output_" + to_string(i + 1) + ".txt";
+    }
+
+    int threads = worker_threads();
+    cout.setstate(ios::badbit);
+    parallel_for(runs.size(), threads, [&](int i) {
+        run_scenario(base, runs[i]);
+    });
+    cout.clear();
+
+    for (auto& run : runs) {
+        printf("Scenario %s -> %s: %d epochs, %.1f ms\n",
+               run.changes, run.output.c_str(), run.epochs, run.ms);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("Batch: %d scenarios on %d threads in %.1f ms\n", (int)runs.size(), threads, ms);
+
+    base_topology = NULL;
+    for (auto p : base) {
+        delete p.second;
+    }
+    topology.clear();
+    return 0;
+}
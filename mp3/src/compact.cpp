@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#include "graph.h"
+#include "linkstate.h"
+
+using namespace std;
+
+/**
+ * Number the nodes in depth-first preorder, visiting neighbors in ID
+ * order and starting a new search from the lowest unvisited ID for
+ * each component.  Nodes close together in the topology end up close
+ * together in the order, so the destinations behind one next hop
+ * tend to form a few long runs.
+ *
+ * @param graph Graph to order
+ * @param order Ordering to fill
+ */
+void locality_order(const graph_t& graph, order_t& order) {
+    int n = graph.ids.size();
+    order.pos.assign(n, -1);
+    order.node.clear();
+
+    vector<int> stack;
+    for (int s = 0; s < n; s++) {
+        if (order.pos[s] >= 0) {
+            continue;
+        }
+        stack.push_back(s);
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            if (order.pos[u] >= 0) {
+                continue;
+            }
+            order.pos[u] = order.node.size();
+            order.node.push_back(u);
+            // push in reverse so the lowest ID neighbor is visited first
+            for (int e = graph.offset[u + 1] - 1; e >= graph.offset[u]; e--) {
+                if (order.pos[graph.adj[e]] < 0) {
+                    stack.push_back(graph.adj[e]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Compress one routing table.  Destinations are walked in locality
+ * order and each change of next hop starts a new run.  Path costs are
+ * not kept per destination: every next hop lies on a shortest path,
+ * so cost(src, dest) = link(src, hop) + cost(hop, dest), and each run
+ * only needs the cost of the link to its hop.
+ *
+ * @param graph  Graph the table was computed on
+ * @param order  Locality ordering of the graph
+ * @param source Dense index of the node owning the table
+ * @param table  Routing table with one entry per node, in ID order
+ * @param ct     Compressed table to fill
+ */
+void compress_table(const graph_t& graph, const order_t& order, int source, const vector<entry_t>& table, ctable_t& ct) {
+    int n = order.node.size();
+    ct.run_start.clear();
+    ct.run_hop.clear();
+    ct.run_cost.clear();
+
+    for (int p = 0; p < n; p++) {
+        const entry_t& entry = table[order.node[p]];
+        int hop = entry.next_hop < 0 || entry.path_cost < 0 ? -1 : graph.index.at(entry.next_hop);
+        if (ct.run_hop.empty() || ct.run_hop.back() != hop) {
+            ct.run_start.push_back(p);
+            ct.run_hop.push_back(hop);
+            ct.run_cost.push_back(hop < 0 || hop == source ? 0 : link_cost(graph, source, hop));
+        }
+    }
+    ct.run_start.shrink_to_fit();
+    ct.run_hop.shrink_to_fit();
+    ct.run_cost.shrink_to_fit();
+}
+
+/**
+ * Look up a destination in a compressed table with a binary search
+ * over the runs, O(log k) for k runs.
+ *
+ * @param ct    Compressed table
+ * @param order Locality ordering the table was built with
+ * @param dest  Dense index of the destination
+ * @param link  Set to the cost of the link to the next hop
+ * @return      Dense index of the next hop, or -1 if unreachable
+ */
+int compact_lookup(const ctable_t& ct, const order_t& order, int dest, int& link) {
+    int p = order.pos[dest];
+    int run = upper_bound(ct.run_start.begin(), ct.run_start.end(), p) - ct.run_start.begin() - 1;
+    link = ct.run_cost[run];
+    return ct.run_hop[run];
+}
+
+/**
+ * Resident size of a compressed table in bytes.
+ */
+size_t compact_bytes(const ctable_t& ct) {
+    return sizeof(ct) + (ct.run_start.capacity() + ct.run_hop.capacity() + ct.run_cost.capacity()) * sizeof(int);
+}
+
+// compressed tables of the current epoch, by dense index; per thread for --batch
+static thread_local graph_t compact_graph;
+static thread_local order_t compact_order;
+static thread_local vector<ctable_t> compact_tables;
+
+/**
+ * Start a new epoch of compressed tables for the current topology.
+ */
+void compact_begin() {
+    build_graph(topology, compact_graph);
+    locality_order(compact_graph, compact_order);
+    compact_tables.assign(compact_graph.ids.size(), ctable_t());
+}
+
+/**
+ * Compress and keep one node's freshly computed table.
+ *
+ * @param id    Node ID the table belongs to
+ * @param table Routing table with one entry per node, in ID order
+ */
+void compact_save(int id, vector<entry_t>& table) {
+    int source = compact_graph.index[id];
+    compress_table(compact_graph, compact_order, source, table, compact_tables[source]);
+}
+
+/**
+ * Print how much memory the compressed tables take compared with
+ * the vector<entry_t> tables they replace.
+ */
+void compact_report() {
+    size_t runs = 0, bytes = 0;
+    for (auto& ct : compact_tables) {
+        runs += ct.run_start.size();
+        bytes += compact_bytes(ct);
+    }
+    size_t n = compact_tables.size();
+    size_t plain = n * (sizeof(vector<entry_t>) + n * sizeof(entry_t));
+    cout << "Compact tables: " << n << " nodes, " << runs << " runs, "
+         << bytes << " bytes vs " << plain << " bytes uncompressed ("
+         << (bytes ? (double)plain / bytes : 0) << "x)" << endl;
+}
+
+/**
+ * Follow the compressed tables hop by hop, exactly as trace_route()
+ * follows the uncompressed ones, adding up the path cost on the way.
+ *
+ * @param src  Source node ID
+ * @param dest Destination node ID
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, -1 if dest is unreachable, -2 if src has no table
+ */
+int compact_trace(int src, int dest, queue<int>& hops) {
+    auto s = compact_graph.index.find(src);
+    auto d = compact_graph.index.find(dest);
+    if (s == compact_graph.index.end()) {
+        return -2;
+    }
+    if (d == compact_graph.index.end()) {
+        return -1;
+    }
+
+    int link;
+    int next_hop = compact_lookup(compact_tables[s->second], compact_order, d->second, link);
+    if (next_hop < 0) {
+        return -1;
+    }
+
+    int cost = link;
+    hops.push(src);
+    while (next_hop != d->second) {
+        hops.push(compact_graph.ids[next_hop]);
+        next_hop = compact_lookup(compact_tables[next_hop], compact_order, d->second, link);
+        cost += link;
+    }
+    return cost;
+}
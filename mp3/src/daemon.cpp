@@ -0,0 +1,342 @@
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "graph.h"
+#include "linkstate.h"
+
+using namespace std;
+
+/**
+ * Routing Snapshot Struct
+ *   Immutable, versioned view of the network used to answer queries.
+ *   A reader keeps the snapshot it started with for the whole query,
+ *   so an UPDATE never disturbs a query already in flight.  Trees that
+ *   an update does not affect are shared with the previous version.
+ */
+typedef struct snapshot {
+    unsigned long                   version;    // bumped once per applied UPDATE
+    graph_t                         graph;      // topology the trees were computed on
+    vector<shared_ptr<const spt_t>> trees;      // shortest path tree rooted at each node
+} snapshot_t;
+
+// snapshot currently served to readers
+static shared_ptr<const snapshot_t> current;
+// serializes writers; readers never take it
+static mutex update_lock;
+// topology loaded by the main thread, which client threads update
+static map<int, node_t*>* daemon_topology;
+
+/**
+ * Compute the shortest path tree for every node of a snapshot.
+ *
+ * @param snap Snapshot whose graph is already built
+ */
+static void compute_all_trees(snapshot_t& snap) {
+    int n = snap.graph.ids.size();
+    snap.trees.resize(n);
+    for (int s = 0; s < n; s++) {
+        shared_ptr<spt_t> tree = make_shared<spt_t>();
+        shortest_path_tree(snap.graph, s, *tree);
+        snap.trees[s] = tree;
+    }
+}
+
+/**
+ * Decide whether changing the link a <-> b can change a tree.
+ * Raising or removing a link only matters if the tree uses it, and
+ * lowering or adding one only matters if it reaches one end at no
+ * more than the current cost (equal cost can still flip a tie).
+ *
+ * @param tree     Tree computed before the change
+ * @param a        Dense index of one end of the link
+ * @param b        Dense index of the other end
+ * @param old_cost Link cost before the change, -1 if absent
+ * @param new_cost Link cost after the change, -1 if removed
+ * @return         true if the tree must be recomputed
+ */
+static bool tree_affected(const spt_t& tree, int a, int b, int old_cost, int new_cost) {
+    if (old_cost == new_cost) {
+        return false;
+    }
+    if (old_cost != -1 && (new_cost == -1 || new_cost > old_cost)) {
+        return tree.parent[b] == a || tree.parent[a] == b;
+    }
+
+    int da = tree.dist[a], db = tree.dist[b];
+    if (da == -1 && db == -1) {
+        return false;
+    }
+    if (da == -1 || db == -1) {
+        return true;
+    }
+    return da + new_cost <= db || db + new_cost <= da;
+}
+
+/**
+ * Apply a link change to the topology and publish a new snapshot,
+ * recomputing only the trees the change can affect.  A change that
+ * adds nodes renumbers the graph, so every tree is recomputed.
+ *
+ * @param a          One end of the link
+ * @param b          The other end of the link
+ * @param cost       New link cost, or -999 to remove the link
+ * @param version    Set to the version serving after the change
+ * @param recomputed Set to the number of trees recomputed
+ */
+static void apply_update(int a, int b, int cost, unsigned long& version, int& recomputed) {
+    lock_guard<mutex> lock(update_lock);
+    map<int, node_t*>& topology = *daemon_topology;
+    shared_ptr<const snapshot_t> old = atomic_load(&current);
+    recomputed = 0;
+
+    // removing a link between unknown nodes changes nothing
+    bool known = topology.count(a) && topology.count(b);
+    int old_cost = -1;
+    if (known && topology[a]->neighbors.count(b)) {
+        old_cost = topology[a]->neighbors[b];
+    }
+    int new_cost = cost > 0 ? cost : -1;
+    if (old_cost == new_cost) {
+        version = old->version;
+        return;
+    }
+
+    // create any new nodes the same way read_topology() does
+    for (int id : {a, b}) {
+        if (topology.find(id) == topology.end()) {
+            node_t* node = new node_t;
+            node->id = id;
+            topology[id] = node;
+        }
+    }
+    if (new_cost == -1) {
+        topology[a]->neighbors.erase(b);
+        topology[b]->neighbors.erase(a);
+    }
+    else {
+        topology[a]->neighbors[b] = new_cost;
+        topology[b]->neighbors[a] = new_cost;
+    }
+
+    shared_ptr<snapshot_t> next = make_shared<snapshot_t>();
+    next->version = old->version + 1;
+    build_graph(topology, next->graph);
+
+    if (!known) {
+        compute_all_trees(*next);
+        recomputed = next->trees.size();
+    }
+    else {
+        int ia = next->graph.index[a];
+        int ib = next->graph.index[b];
+        next->trees = old->trees;
+        for (int s = 0; s < (int)next->trees.size(); s++) {
+            if (tree_affected(*old->trees[s], ia, ib, old_cost, new_cost)) {
+                shared_ptr<spt_t> tree = make_shared<spt_t>();
+                shortest_path_tree(next->graph, s, *tree);
+                next->trees[s] = tree;
+                recomputed++;
+            }
+        }
+    }
+
+    atomic_store(&current, shared_ptr<const snapshot_t>(next));
+    version = next->version;
+}
+
+/**
+ * Answer a ROUTE query by following each hop's own forwarding
+ * entry, exactly as send_messages() does.  The reply matches the
+ * line send_messages() writes, without the message text.
+ */
+static void route_query(const snapshot_t& snap, int src, int dest, FILE* out) {
+    auto s = snap.graph.index.find(src);
+    auto d = snap.graph.index.find(dest);
+    if (s == snap.graph.index.end() || d == snap.graph.index.end()) {
+        fprintf(out, "ERR unknown node %d\n", s == snap.graph.index.end() ? src : dest);
+        return;
+    }
+
+    const spt_t& tree = *snap.trees[s->second];
+    if (tree.dist[d->second] < 0) {
+        fprintf(out, "from %d to %d cost infinite hops unreachable\n", src, dest);
+        return;
+    }
+
+    fprintf(out, "from %d to %d cost %d hops %d", src, dest, tree.dist[d->second], src);
+    int hop = tree.next_hop[d->second];
+    while (hop != d->second) {
+        fprintf(out, " %d", snap.graph.ids[hop]);
+        hop = snap.trees[hop]->next_hop[d->second];
+    }
+    fprintf(out, "\n");
+}
+
+/**
+ * Answer a TABLE query with the node's forwarding table in the
+ * print_table() format, terminated by an empty line.
+ */
+static void table_query(const snapshot_t& snap, int id, FILE* out) {
+    auto s = snap.graph.index.find(id);
+    if (s == snap.graph.index.end()) {
+        fprintf(out, "ERR unknown node %d\n", id);
+        return;
+    }
+
+    const spt_t& tree = *snap.trees[s->second];
+    for (int i = 0; i < (int)snap.graph.ids.size(); i++) {
+        if (i == s->second) {
+            fprintf(out, "%d %d 0\n", id, id);
+        }
+        else if (tree.dist[i] >= 0) {
+            fprintf(out, "%d %d %d\n", snap.graph.ids[i], snap.graph.ids[tree.next_hop[i]], tree.dist[i]);
+        }
+    }
+    fprintf(out, "\n");
+}
+
+/**
+ * Serve the line protocol on a pair of streams until the client
+ * sends QUIT or closes its end.
+ *   ROUTE src dst      path and cost from src to dst
+ *   TABLE n            forwarding table of node n
+ *   UPDATE a b cost    set a link cost, -999 removes the link
+ */
+static void serve(FILE* in, FILE* out) {
+    char* line = NULL;
+    size_t cap = 0;
+    char cmd[16];
+    int a, b, cost;
+
+    while (getline(&line, &cap, in) != -1) {
+        int fields = sscanf(line, "%15s %d %d %d", cmd, &a, &b, &cost);
+        if (fields < 1) {
+            continue;
+        }
+        if (strcmp(cmd, "QUIT") == 0) {
+            break;
+        }
+        else if (strcmp(cmd, "ROUTE") == 0 && fields == 3) {
+            shared_ptr<const snapshot_t> snap = atomic_load(&current);
+            route_query(*snap, a, b, out);
+        }
+        else if (strcmp(cmd, "TABLE") == 0 && fields == 2) {
+            shared_ptr<const snapshot_t> snap = atomic_load(&current);
+            table_query(*snap, a, out);
+        }
+        else if (strcmp(cmd, "UPDATE") == 0 && fields == 4) {
+            if (cost <= 0 && cost != -999) {
+                fprintf(out, "ERR invalid cost %d\n", cost);
+            }
+            else {
+                unsigned long version;
+                int recomputed;
+                apply_update(a, b, cost, version, recomputed);
+                fprintf(out, "OK version %lu recomputed %d\n", version, recomputed);
+            }
+        }
+        else {
+            fprintf(out, "ERR bad command\n");
+        }
+        fflush(out);
+    }
+    free(line);
+}
+
+/**
+ * Serve one socket client, then close the connection.
+ */
+static void serve_client(int fd) {
+    FILE* in = fdopen(fd, "r");
+    FILE* out = fdopen(dup(fd), "w");
+    if (in != NULL && out != NULL) {
+        serve(in, out);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    else {
+        close(fd);
+    }
+}
+
+/**
+ * Run as a long-lived route query daemon on the already loaded
+ * topology.  Every tree is computed once up front; afterwards
+ * UPDATEs recompute only the affected trees and publish a new
+ * snapshot, while any number of readers query the old one.
+ *
+ * @param socket_path Unix socket to listen on, or NULL for stdin/stdout
+ * @return            0 on clean exit, nonzero on socket errors
+ */
+int run_daemon(const char* socket_path) {
+    daemon_topology = &topology;
+    shared_ptr<snapshot_t> first = make_shared<snapshot_t>();
+    first->version = 0;
+    build_graph(topology, first->graph);
+    compute_all_trees(*first);
+    atomic_store(&current, shared_ptr<const snapshot_t>(first));
+    fprintf(stderr, "linkstate: loaded %d nodes\n", (int)first->graph.ids.size());
+
+    if (socket_path == NULL) {
+        serve(stdin, stdout);
+        return 0;
+    }
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("daemon: socket");
+        return 1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    unlink(socket_path);
+    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("daemon: bind");
+        close(sockfd);
+        return 1;
+    }
+    if (listen(sockfd, 16) == -1) {
+        perror("daemon: listen");
+        close(sockfd);
+        return 1;
+    }
+    // a client hanging up mid-reply must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "linkstate: listening on %s\n", socket_path);
+
+    // one thread per client; they only share the published snapshot
+    while (1) {
+        int fd = accept(sockfd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("daemon: accept");
+            break;
+        }
+        thread(serve_client, fd).detach();
+    }
+
+    close(sockfd);
+    unlink(socket_path);
+    return 1;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
@@ -9,20 +10,11 @@
 #include <unordered_map>
 #include <vector>
 
-#define DISTVEC
-#include "routing.h"
+#include "distvec.h"
+#include "stream.h"
 
 using namespace std;
 
-void read_topology();
-void read_messages();
-void send_messages();
-void update_tables();
-void DistVec(int source, vector<entry_t>& table);
-void print_table(vector<entry_t>& table);
-int apply_changes();
-int main(int argc, char** argv);
-
 // output file steam
 ofstream outfile;
 // input file streams
@@ -33,6 +25,31 @@ map<int, node_t*> topology;
 vector<message_t*> message_list;
 // map of nodes to routing lists -- network wide routing info
 map<int, vector<entry_t>> routing_table;
+// run the path-vector protocol next to plain distance vector
+bool pathvec_mode = false;
+// keep a cost row for every node, not just self and neighbors
+bool full_rows = false;
+// let routes to a cut-off partition count up to infinity instead of
+// withdrawing them
+bool count_up = false;
+
+// nodes numbered 0..N-1 in ID order
+vector<node_t*> nodes;
+// node ID -> dense index
+unordered_map<int, int> dense;
+// each node's links as <dense neighbor, cost>, sorted by neighbor
+vector<vector<pair<int, int>>> links;
+// distance vector "infinity", above the cost of any loop-free path
+int dv_infinity = 0;
+// nodes are split into groups by dense index; this process keeps
+// the tables of group dv_group only (all of them unless --procs)
+int dv_groups = 1, dv_group = 0;
+
+// ints in a cache line; cost rows start on one
+#define ROW_ALIGN   16
+
+// one allocation holding every cost row of every node's table
+static int* cost_store = NULL;
 
 
 /**
@@ -91,72 +108,87 @@ void read_messages() {
 }
 
 /**
- * Send messages between nodes, recording the path taken,
- * and write the cost and path to the output file.
+ * Send one message, recording the path taken, and write
+ * the cost and path to the output file.
+ *
+ * @param msg Message to send
  */
-void send_messages() {
-    for (auto msg : message_list) {
-        int src = msg->src;
-        int dest = msg->dest;
+static void send_message(const message_t& msg) {
+    int src = msg.src;
+    int dest = msg.dest;
 
-        outfile << "from " << src << " to " << dest;
-        cout << "Sending message from " << src
-             << " to " << dest
-             << ": " << msg->message << endl;
+    outfile << "from " << src << " to " << dest;
+    cout << "Sending message from " << src
+         << " to " << dest
+         << ": " << msg.message << endl;
 
-        // get source node's forwarding table
-        vector<entry_t> forward_table = routing_table[src];
+    // get source node's forwarding table
+    vector<entry_t> forward_table = routing_table[src];
 
-        if (forward_table.size() == 0) {
-            cout << ">> No routing table for node " << src << ". Skipping message.\n";
-            continue;
-        }
-
-        // find the entry for the destination
-        int index = 0;
-        while (forward_table[index].dest != dest && index < forward_table.size()) {
-            index++;
-        }
+    if (forward_table.size() == 0) {
+        cout << ">> No routing table for node " << src << ". Skipping message.\n";
+        return;
+    }
 
-        // If destination is reachable, trace the hops and print the
-        // cost along with the path taken.  Otherwise print infinite cost
-        // and no path.
-        int cost = forward_table[index].path_cost;
-        if (cost >= 0) {
-            outfile << " cost " << cost << " hops ";
-            cout << ">> Message delivered with cost " << cost << " via nodes ";
+    // find the entry for the destination
+    int index = 0;
+    while (forward_table[index].dest != dest && index < forward_table.size()) {
+        index++;
+    }
 
-            queue<int> hops;
-            hops.push(src);
-            int next_hop = forward_table[index].next_hop;
+    // If destination is reachable, trace the hops and print the
+    // cost along with the path taken.  Otherwise print infinite cost
+    // and no path.
+    int cost = forward_table[index].path_cost;
+    if (cost >= 0) {
+        outfile << " cost " << cost << " hops ";
+        cout << ">> Message delivered with cost " << cost << " via nodes ";
+
+        queue<int> hops;
+        hops.push(src);
+        int next_hop = forward_table[index].next_hop;
+        if (next_hop != dest) {
+            hops.push(next_hop);
+        }
+        // follow the hops until we reach the destination
+        while (next_hop != dest) {
+            forward_table = routing_table[next_hop];
+            index = 0;
+            while (forward_table[index].dest != dest && index < forward_table.size()) {
+                index++;
+            }
+            next_hop = forward_table[index].next_hop;
             if (next_hop != dest) {
                 hops.push(next_hop);
             }
-            // follow the hops until we reach the destination
-            while (next_hop != dest) {
-                forward_table = routing_table[next_hop];
-                index = 0;
-                while (forward_table[index].dest != dest && index < forward_table.size()) {
-                    index++;
-                }
-                next_hop = forward_table[index].next_hop;
-                if (next_hop != dest) {
-                    hops.push(next_hop);
-                }
-            }
+        }
 
-            while (hops.size() > 0) {
-                outfile << hops.front() << ' ';
-                cout << hops.front() << ' ';
-                hops.pop();
-            }
-            outfile << "message " << msg->message << endl;
-            cout << endl;
+        while (hops.size() > 0) {
+            outfile << hops.front() << ' ';
+            cout << hops.front() << ' ';
+            hops.pop();
         }
-        // unreachable node
-        else {
-            outfile << " cost infinite hops unreachable message " << msg->message << endl;
-            cout << ">> Message could not be delivered\n";
+        outfile << "message " << msg.message << endl;
+        cout << endl;
+    }
+    // unreachable node
+    else {
+        outfile << " cost infinite hops unreachable message " << msg.message << endl;
+        cout << ">> Message could not be delivered\n";
+    }
+}
+
+/**
+ * Send messages between nodes, recording the path taken,
+ * and write the cost and path to the output file.
+ */
+void send_messages() {
+    if (stream_mode) {
+        stream_messages(send_message);
+    }
+    else {
+        for (auto msg : message_list) {
+            send_message(*msg);
         }
     }
     outfile << endl;
@@ -168,13 +200,35 @@ void send_messages() {
  * to output file.
  */
 void update_tables() {
+    // let the protocols converge on the current topology
+    convergence_t dv, pv;
+    if (dv_groups > 1) {
+        dist_converge(dv);
+    }
+    else {
+        dv_converge(dv);
+        cout << "Distance vector: converged in " << dv.rounds << " rounds, "
+             << dv.messages << " messages" << endl;
+    }
+    if (pathvec_mode) {
+        pv_converge(pv);
+        cout << "Path vector:     converged in " << pv.rounds << " rounds, "
+             << pv.messages << " messages" << endl;
+        pv_report();
+    }
+
     // loop through the topology data to get each
     // node's forwarding table for updating
     for (auto node : topology) {
         // create a temp table for this node's forwarding info
         vector<entry_t> forward_table;
-        // run distance vector algorithm on this node
-        DistVec(node.first, forward_table);
+        // read the converged table off this node
+        if (pathvec_mode) {
+            PathVec(node.first, forward_table);
+        }
+        else {
+            DistVec(node.first, forward_table);
+        }
         // output the updated table to the outfile
         print_table(forward_table);
         outfile << endl;
@@ -183,9 +237,382 @@ void update_tables() {
     }
 }
 
+/**
+ * Number the nodes 0..N-1 in ID order.  Nodes never leave the
+ * topology, so the numbering only changes when one is added.
+ *
+ * @return true if the nodes were renumbered
+ */
+bool number_nodes() {
+    if (nodes.size() == topology.size()) {
+        return false;
+    }
+    nodes.clear();
+    dense.clear();
+    for (auto p : topology) {
+        dense[p.first] = nodes.size();
+        nodes.push_back(p.second);
+    }
+    return true;
+}
 
-void DistVec(int source, vector<entry_t>& table) {
+/**
+ * Rebuild the sorted link lists from the current topology.
+ *
+ * @return The largest link cost
+ */
+int read_links() {
+    int n = nodes.size();
+    int max_cost = 1;
+    links.assign(n, vector<pair<int, int>>());
+    for (int i = 0; i < n; i++) {
+        for (auto neighbor : nodes[i]->neighbors) {
+            links[i].push_back(make_pair(dense[neighbor.first], neighbor.second));
+            max_cost = max(max_cost, neighbor.second);
+        }
+        sort(links[i].begin(), links[i].end());
+    }
+    return max_cost;
+}
+
+/**
+ * Find the row node y keeps for node x's vector.
+ *
+ * @param y Dense index of the table owner
+ * @param x Dense index of the node the vector belongs to
+ * @return  The row, NULL if y keeps none for x
+ */
+cost_row_t* cost_row(int y, int x) {
+    vector<cost_row_t>& table = nodes[y]->cost_table;
+    if (table.size() == nodes.size()) {
+        return &table[x];
+    }
+    auto it = lower_bound(table.begin(), table.end(), x,
+                          [](const cost_row_t& row, int node) { return row.node < node; });
+    return it != table.end() && it->node == x ? &*it : NULL;
+}
+
+/**
+ * Allocate a cost store of the given number of rows.  The caller
+ * frees the old store once it has copied what it needs from it.
+ *
+ * @param rows   Rows to make room for
+ * @param stride Filled with the ints from one row to the next
+ * @return       The new store
+ */
+static int* new_store(size_t rows, size_t& stride) {
+    stride = (nodes.size() + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+    void* store = NULL;
+    if (rows > 0 && posix_memalign(&store, ROW_ALIGN * sizeof(int), rows * stride * sizeof(int)) != 0) {
+        perror("posix_memalign");
+        exit(1);
+    }
+    return (int*)store;
+}
+
+/**
+ * Give every node a table of its own vector alone, all unreachable,
+ * to be filled with the vectors collected from other processes.
+ */
+void own_rows_only() {
+    int n = nodes.size();
+    size_t stride;
+    int* store = new_store(n, stride);
+    for (int y = 0; y < n; y++) {
+        cost_row_t row;
+        row.node = y;
+        row.heard = true;
+        row.cost = store + y * stride;
+        fill(row.cost, row.cost + n, dv_infinity);
+        nodes[y]->cost_table.assign(1, row);
+        nodes[y]->next_hop.assign(n, -1);
+    }
+    free(cost_store);
+    cost_store = store;
+}
+
+/**
+ * Send node x's distance vector to its neighbor y, which keeps it as
+ * x's row of its cost table.  Poisoned reverse: routes x takes through
+ * y are advertised back to y as infinite.
+ */
+static void dv_send(int x, int y) {
+    int n = nodes.size();
+    const int* dist = cost_row(x, x)->cost;
+    const vector<int>& hop = nodes[x]->next_hop;
+    cost_row_t* row = cost_row(y, x);
+    row->heard = true;
+    for (int d = 0; d < n; d++) {
+        row->cost[d] = hop[d] == y ? dv_infinity : dist[d];
+    }
+}
+
+/**
+ * Bellman-Ford update of node y's own distance vector from the rows
+ * its neighbors last sent.  Neighbors are tried in ID order and only
+ * a strictly better path replaces the best so far, so equal-cost
+ * paths go to the lowest next hop ID.
+ *
+ * @param y       Dense index of the node
+ * @param changed Filled with the destinations whose cost or next hop changed
+ * @return        true if any route changed
+ */
+bool dv_update(int y, vector<int>& changed) {
+    int n = nodes.size();
+    vector<int> best(n, dv_infinity), via(n, -1);
+    for (auto link : links[y]) {
+        const int* row = cost_row(y, link.first)->cost;
+        for (int d = 0; d < n; d++) {
+            int cost = link.second + row[d];
+            if (cost < best[d]) {
+                best[d] = cost;
+                via[d] = link.first;
+            }
+        }
+    }
+    best[y] = 0;
+    via[y] = y;
+
+    int* dist = cost_row(y, y)->cost;
+    vector<int>& hop = nodes[y]->next_hop;
+    changed.clear();
+    for (int d = 0; d < n; d++) {
+        if (best[d] >= dv_infinity) {
+            best[d] = dv_infinity;
+            via[d] = -1;
+        }
+        if (dist[d] != best[d] || hop[d] != via[d]) {
+            dist[d] = best[d];
+            hop[d] = via[d];
+            changed.push_back(d);
+        }
+    }
+    return !changed.empty();
+}
+
+/**
+ * Whether this process keeps the tables of a node.
+ */
+bool owned(int y) {
+    return y % dv_groups == dv_group;
+}
+
+/**
+ * Withdraw every route to a node the topology no longer connects to
+ * its owner, in the owner's vector and in the neighbor rows it keeps.
+ * Counting those up to infinity takes rounds in proportion to N times
+ * the dearest link, so unless --count-up asks for that, a partition is
+ * treated as a withdrawal seen by the whole side at once.
+ */
+static void withdraw_lost() {
+    int n = nodes.size();
+    vector<int> component(n, -1), stack;
+    for (int s = 0; s < n; s++) {
+        if (component[s] >= 0) {
+            continue;
+        }
+        component[s] = s;
+        stack.push_back(s);
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            for (auto link : links[u]) {
+                if (component[link.first] < 0) {
+                    component[link.first] = s;
+                    stack.push_back(link.first);
+                }
+            }
+        }
+    }
 
+    for (int y = 0; y < n; y++) {
+        if (!owned(y)) {
+            continue;
+        }
+        for (int d = 0; d < n; d++) {
+            if (component[d] == component[y]) {
+                continue;
+            }
+            for (auto& row : nodes[y]->cost_table) {
+                row.cost[d] = dv_infinity;
+            }
+            nodes[y]->next_hop[d] = -1;
+        }
+    }
+}
+
+/**
+ * Get the nodes of this process ready for a new epoch: number the
+ * nodes and read their links, rescale infinity, and forget the rows
+ * of lost neighbors.  State otherwise carries over, so after a change
+ * only the affected routes move.  Routes into a partition the change
+ * cut off are withdrawn at once; with --count-up they count up to
+ * infinity as they would in a real network.
+ *
+ * The tables are laid out again in a new store each epoch, each node's
+ * rows back to back: its own vector and its neighbors', or a row for
+ * every node with --full-rows.  Rows still kept are copied over.
+ *
+ * @param greet Filled with each node's new neighbors, which still
+ *              need to be sent its whole vector
+ */
+void dv_begin(vector<vector<int>>& greet) {
+    bool fresh = number_nodes();
+    int n = nodes.size();
+
+    // any loop-free path costs less than N - 1 of the dearest link
+    int old_infinity = dv_infinity;
+    dv_infinity = (int)min((long)(n - 1) * read_links() + 1, (long)INT_MAX / 2);
+
+    size_t rows = 0;
+    for (int y = 0; y < n; y++) {
+        if (owned(y)) {
+            rows += full_rows ? n : links[y].size() + 1;
+        }
+    }
+    size_t stride;
+    int* store = new_store(rows, stride);
+    int* next = store;
+
+    greet.assign(n, vector<int>());
+    vector<bool> linked(n, false);
+    vector<int> keep;
+    vector<cost_row_t> table;
+    for (int y = 0; y < n; y++) {
+        if (!owned(y)) {
+            continue;
+        }
+        // the nodes whose rows y keeps, in order
+        keep.clear();
+        for (auto link : links[y]) {
+            linked[link.first] = true;
+            keep.push_back(link.first);
+        }
+        if (full_rows) {
+            keep.resize(n);
+            for (int x = 0; x < n; x++) {
+                keep[x] = x;
+            }
+        }
+        else {
+            keep.insert(lower_bound(keep.begin(), keep.end(), y), y);
+        }
+
+        // copy rows over, keeping infinite routes infinite under the
+        // new bound; forget rows from lost neighbors, note new ones
+        table.clear();
+        for (int x : keep) {
+            cost_row_t row;
+            row.node = x;
+            row.cost = next;
+            next += stride;
+            cost_row_t* old = fresh ? NULL : cost_row(y, x);
+            row.heard = old != NULL && old->heard && (x == y || linked[x]);
+            if (row.heard) {
+                for (int d = 0; d < n; d++) {
+                    row.cost[d] = old->cost[d] >= old_infinity ? dv_infinity : old->cost[d];
+                }
+            }
+            else {
+                fill(row.cost, row.cost + n, dv_infinity);
+                if (linked[x]) {
+                    greet[y].push_back(x);
+                }
+            }
+            table.push_back(row);
+        }
+        nodes[y]->cost_table.swap(table);
+        for (auto link : links[y]) {
+            linked[link.first] = false;
+        }
+
+        if (fresh) {
+            cost_row_t* self = cost_row(y, y);
+            self->heard = true;
+            self->cost[y] = 0;
+            nodes[y]->next_hop.assign(n, -1);
+            nodes[y]->next_hop[y] = y;
+        }
+    }
+    free(cost_store);
+    cost_store = store;
+
+    if (!fresh && !count_up) {
+        withdraw_lost();
+    }
+}
+
+/**
+ * Run synchronous distance vector rounds until no node's vector
+ * changes.  Each node keeps its own vector as row self of its cost
+ * table and the last vector from each neighbor as that neighbor's row.
+ *
+ * @param stats Filled with the rounds and messages it took
+ */
+void dv_converge(convergence_t& stats) {
+    stats.rounds = 0;
+    stats.messages = 0;
+    vector<vector<int>> greet;
+    dv_begin(greet);
+    int n = nodes.size();
+
+    // links are symmetric, so every new neighbor greets back
+    for (int y = 0; y < n; y++) {
+        for (int x : greet[y]) {
+            dv_send(x, y);
+            stats.messages++;
+        }
+    }
+
+    // every node looks at its links once; after that only
+    // nodes that heard a new vector recompute
+    vector<bool> dirty(n, true), changed(n, false);
+    vector<int> dests;
+    while (1) {
+        bool any = false;
+        for (int y = 0; y < n; y++) {
+            if (dirty[y] && dv_update(y, dests)) {
+                changed[y] = true;
+                any = true;
+            }
+            dirty[y] = false;
+        }
+        if (!any) {
+            break;
+        }
+
+        stats.rounds++;
+        for (int x = 0; x < n; x++) {
+            if (!changed[x]) {
+                continue;
+            }
+            for (auto link : links[x]) {
+                dv_send(x, link.first);
+                dirty[link.first] = true;
+                stats.messages++;
+            }
+            changed[x] = false;
+        }
+    }
+}
+
+/**
+ * Read one node's converged distance vector table.
+ *
+ * @param source Node ID of the table owner
+ * @param table  Routing table to be filled for source node
+ */
+void DistVec(int source, vector<entry_t>& table) {
+    int s = dense[source];
+    const int* dist = cost_row(s, s)->cost;
+    const vector<int>& hop = nodes[s]->next_hop;
+    for (int d = 0; d < (int)nodes.size(); d++) {
+        entry_t entry;
+        entry.dest = nodes[d]->id;
+        entry.next_hop = hop[d] < 0 ? -1 : nodes[hop[d]]->id;
+        entry.path_cost = hop[d] < 0 ? -1 : dist[d];
+        table.push_back(entry);
+    }
 }
 
 /**
@@ -221,22 +648,21 @@ void print_table(vector<entry_t>& table) {
  */
 int apply_changes() {
     int src, dest, cost;
-    if (changesfile.is_open() && !changesfile.eof()) {
-        changesfile >> src >> dest >> cost;
+    if (changesfile.is_open() && changesfile >> src >> dest >> cost) {
         // update an existing link or add a new one
         // if it doesn't already exist
         if (cost > 0) {
             printf("Setting link %d <-> %d to %d\n", src, dest, cost);
-            topology[src]->neighbors[dest] = cost;
-            topology[dest]->neighbors[src] = cost;
-            // return successful change
-            return 1;
         }
         // remove a link or do nothing if no link exists
         else if (cost == -999) {
             printf("Removing link %d <-> %d\n", src, dest);
-            topology[src]->neighbors.erase(dest);
-            topology[dest]->neighbors.erase(src);
+        }
+        if (set_link(src, dest, cost)) {
+            // the worker processes keep their own topology
+            if (dv_groups > 1) {
+                dist_change(src, dest, cost);
+            }
             // return successful change
             return 1;
         }
@@ -246,22 +672,85 @@ int apply_changes() {
     return 0;
 }
 
+/**
+ * Set the cost of a link, -999 to remove it.
+ *
+ * @return 1 if the change was valid, 0 otherwise
+ */
+int set_link(int src, int dest, int cost) {
+    if (cost > 0) {
+        // add any node that is new to the topology
+        for (int id : {src, dest}) {
+            if (topology.find(id) == topology.end()) {
+                node_t* node = new node_t;
+                node->id = id;
+                topology[id] = node;
+            }
+        }
+        topology[src]->neighbors[dest] = cost;
+        topology[dest]->neighbors[src] = cost;
+        return 1;
+    }
+    else if (cost == -999) {
+        if (topology.count(src) && topology.count(dest)) {
+            topology[src]->neighbors.erase(dest);
+            topology[dest]->neighbors.erase(src);
+        }
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
     //printf("Number of arguments: %d", argc);
-    if (argc != 4) {
-        printf("Usage: ./distvec topofile messagefile changesfile\n");
+    // pull out the optional mode flags, leaving the file names
+    vector<char*> files;
+    int procs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--pathvec") {
+            pathvec_mode = true;
+        }
+        else if (string(argv[i]) == "--full-rows") {
+            full_rows = true;
+        }
+        else if (string(argv[i]) == "--stream") {
+            stream_mode = true;
+        }
+        else if (string(argv[i]) == "--count-up") {
+            count_up = true;
+        }
+        else if (string(argv[i]).compare(0, 8, "--procs=") == 0) {
+            procs = atoi(argv[i] + 8);
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.size() != 3 || procs < 1) {
+        printf("Usage: ./distvec [--pathvec] [--procs=N] [--full-rows] [--stream] [--count-up] topofile messagefile changesfile\n");
         return -1;
     }
 
     // open the files
     outfile.open("output.txt");
-    topofile.open(argv[1]);
-    messagefile.open(argv[2]);
-    changesfile.open(argv[3]);
+    topofile.open(files[0]);
+    changesfile.open(files[2]);
 
-    // read initial state data
+    // read initial state data; streamed messages are mapped, not read
     read_topology();
-    read_messages();
+    if (stream_mode) {
+        stream_open(files[1]);
+    }
+    else {
+        messagefile.open(files[1]);
+        read_messages();
+    }
+
+    // hand the nodes out to worker processes
+    if (procs > 1) {
+        dist_start(procs);
+    }
 
     // Update the routing tables and send messages
     // as long as there are changes to be made
@@ -270,10 +759,15 @@ int main(int argc, char** argv) {
         send_messages();
     } while (0 != apply_changes());
 
+    if (procs > 1) {
+        dist_stop();
+    }
+
     // cleanup allocated memory
     for (auto msg : message_list) {
         delete msg;
     }
+    stream_close();
 
     // close the files
     outfile.close();
@@ -0,0 +1,78 @@
+#ifndef _DISTVEC_H
+#define _DISTVEC_H
+
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define DISTVEC
+#include "routing.h"
+
+using namespace std;
+
+/**
+ * Convergence Statistics Struct
+ *   How long one protocol took to converge after a change.
+ */
+typedef struct convergence {
+    int     rounds;     // synchronous exchange rounds until nothing changed
+    long    messages;   // vectors sent, one per (sender, neighbor) per round
+} convergence_t;
+
+void read_topology();
+void read_messages();
+void send_messages();
+void update_tables();
+bool number_nodes();
+int read_links();
+bool owned(int y);
+cost_row_t* cost_row(int y, int x);
+void own_rows_only();
+void dv_begin(vector<vector<int>>& greet);
+bool dv_update(int y, vector<int>& changed);
+void dv_converge(convergence_t& stats);
+void DistVec(int source, vector<entry_t>& table);
+void pv_converge(convergence_t& stats);
+void PathVec(int source, vector<entry_t>& table);
+void pv_report();
+void print_table(vector<entry_t>& table);
+void dist_start(int procs);
+void dist_change(int src, int dest, int cost);
+void dist_converge(convergence_t& stats);
+void dist_stop();
+int apply_changes();
+int set_link(int src, int dest, int cost);
+int main(int argc, char** argv);
+
+// output file steam
+extern ofstream outfile;
+// input file streams
+extern ifstream topofile, messagefile, changesfile;
+// map of node IDs to node structures storing topology info
+extern map<int, node_t*> topology;
+// list of messages to send between nodes
+extern vector<message_t*> message_list;
+// map of nodes to routing lists -- network wide routing info
+extern map<int, vector<entry_t>> routing_table;
+// run the path-vector protocol next to plain distance vector
+extern bool pathvec_mode;
+// keep a cost row for every node, not just self and neighbors
+extern bool full_rows;
+// let routes to a cut-off partition count up to infinity
+extern bool count_up;
+
+// nodes numbered 0..N-1 in ID order
+extern vector<node_t*> nodes;
+// node ID -> dense index
+extern unordered_map<int, int> dense;
+// each node's links as <dense neighbor, cost>, sorted by neighbor
+extern vector<vector<pair<int, int>>> links;
+// distance vector "infinity", above the cost of any loop-free path
+extern int dv_infinity;
+// nodes are split into groups by dense index; this process keeps
+// the tables of group dv_group only (all of them unless --procs)
+extern int dv_groups, dv_group;
+
+#endif /* _DISTVEC_H */
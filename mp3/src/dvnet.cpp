@@ -0,0 +1,654 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "distvec.h"
+
+using namespace std;
+
+#define DV_PORT     4950    // worker g listens on DV_PORT + g, the coordinator after the last one
+#define DV_DATAGRAM 65000   // largest datagram we send, in bytes
+#define DV_TIMEOUT  200     // ms to wait before asking for a resend
+#define DV_RETRIES  50      // resends before giving up on a process
+
+/**
+ * Datagram types.  The coordinator sends ROUND, COLLECT and QUIT and
+ * gets DONE back; workers send each other UPDATEs and the coordinator
+ * TABLEs, and ask for lost ones again with a NACK.
+ */
+enum packet_type { PKT_ROUND, PKT_COLLECT, PKT_QUIT, PKT_DONE, PKT_UPDATE, PKT_TABLE, PKT_NACK };
+
+/**
+ * Datagram Header Struct
+ *   Starts every datagram, followed by count payload items: int32s
+ *   for control datagrams, route records for UPDATE and TABLE.  All
+ *   processes run on one host, so fields are in host byte order.
+ */
+typedef struct dv_header {
+    uint32_t    type;   // packet_type
+    uint32_t    round;  // round the datagram belongs to
+    uint32_t    from;   // sending group, dv_groups for the coordinator
+    uint32_t    seq;    // datagram number within the round, per receiver
+    uint32_t    count;  // payload items
+} dv_header_t;
+
+/**
+ * Route Record Struct
+ *   One route of one node, by dense index.
+ */
+typedef struct dv_record {
+    int32_t     node;   // node the route belongs to
+    int32_t     dest;   // destination
+    int32_t     cost;   // path cost, dv_infinity or more if unreachable
+    int32_t     hop;    // next hop, -1 if unreachable
+} dv_record_t;
+
+#define DV_BATCH ((DV_DATAGRAM - sizeof(dv_header_t)) / sizeof(dv_record_t))
+
+static int sockfd = -1;
+static vector<struct sockaddr_in> group_addr;   // by group, coordinator last
+static vector<pid_t> workers;
+static pid_t coordinator;
+
+// datagrams sent in the last two rounds, kept for resends: by round
+// parity, then receiving group
+static uint32_t sent_round[2];
+static vector<vector<string>> sent_log[2];
+static long resent = 0;
+
+// data datagrams received, by round, then sender, then seq
+static map<uint32_t, vector<map<uint32_t, string>>> inbox;
+static uint32_t inbox_floor = 0;    // older rounds are done with
+// control datagrams waiting to be handled
+static deque<string> control;
+
+// the change the next epoch starts with
+static int change_src = -1, change_dest = -1, change_cost = 0;
+// the coordinator's round clock, carried on across epochs
+static uint32_t clock_round = 0;
+
+/**
+ * Open this process's socket on localhost.
+ */
+static void dist_socket(int group) {
+    struct addrinfo hints, *servinfo, *p;
+    int rv;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    string port = to_string(DV_PORT + group);
+    if ((rv = getaddrinfo("127.0.0.1", port.c_str(), &hints, &servinfo)) != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+        exit(1);
+    }
+
+    // loop through all the results and bind to the first we can
+    for (p = servinfo; p != NULL; p = p->ai_next) {
+        if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+            perror("distvec: socket");
+            continue;
+        }
+        if (bind(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+            close(sockfd);
+            perror("distvec: bind");
+            continue;
+        }
+        break;
+    }
+
+    if (p == NULL) {
+        fprintf(stderr, "distvec: failed to bind socket on port %s\n", port.c_str());
+        exit(2);
+    }
+    freeaddrinfo(servinfo);
+
+    // a whole round of updates can land while a worker is computing
+    int size = 64 << 20;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size) == -1) {
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    }
+}
+
+/**
+ * Send one datagram to a group, or to the coordinator.
+ */
+static void dist_send(int to, uint32_t type, uint32_t round, uint32_t seq, const void* payload, uint32_t count, size_t item) {
+    string packet(sizeof(dv_header_t) + count * item, '\0');
+    dv_header_t* header = (dv_header_t*)&packet[0];
+    header->type = type;
+    header->round = round;
+    header->from = dv_group;
+    header->seq = seq;
+    header->count = count;
+    if (count > 0) {
+        memcpy(&packet[sizeof(dv_header_t)], payload, count * item);
+    }
+    if (sendto(sockfd, packet.data(), packet.size(), 0,
+               (struct sockaddr*)&group_addr[to], sizeof(struct sockaddr_in)) == -1) {
+        perror("distvec: sendto");
+    }
+    if (type == PKT_UPDATE || type == PKT_TABLE) {
+        sent_log[round % 2][to].push_back(packet);
+    }
+}
+
+/**
+ * Send a control datagram of int32s.
+ */
+static void dist_control(int to, uint32_t type, uint32_t round, const vector<int32_t>& payload) {
+    dist_send(to, type, round, 0, payload.data(), payload.size(), sizeof(int32_t));
+}
+
+/**
+ * Start keeping the data datagrams of a new round.
+ */
+static void dist_new_round(uint32_t round) {
+    sent_round[round % 2] = round;
+    sent_log[round % 2].assign(dv_groups + 1, vector<string>());
+}
+
+/**
+ * Wait up to timeout ms for datagrams and sort out everything that
+ * arrived: data goes to the inbox, resend requests are answered on
+ * the spot, and control datagrams are queued for the caller.
+ *
+ * @return true if anything arrived
+ */
+static bool dist_poll(int timeout) {
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout) <= 0) {
+        return false;
+    }
+
+    static char buf[DV_DATAGRAM];
+    int numbytes;
+    while ((numbytes = recvfrom(sockfd, buf, sizeof buf, MSG_DONTWAIT, NULL, NULL)) > 0) {
+        if (numbytes < (int)sizeof(dv_header_t)) {
+            continue;
+        }
+        dv_header_t* header = (dv_header_t*)buf;
+        if (header->type == PKT_UPDATE || header->type == PKT_TABLE) {
+            if (header->round >= inbox_floor) {
+                auto& senders = inbox[header->round];
+                senders.resize(dv_groups + 1);
+                senders[header->from][header->seq] = string(buf, numbytes);
+            }
+        }
+        else if (header->type == PKT_NACK) {
+            // send the whole round to the group again; it drops duplicates
+            int parity = header->round % 2;
+            if (sent_round[parity] == header->round && !sent_log[parity].empty()) {
+                for (auto& packet : sent_log[parity][header->from]) {
+                    sendto(sockfd, packet.data(), packet.size(), 0,
+                           (struct sockaddr*)&group_addr[header->from], sizeof(struct sockaddr_in));
+                    resent++;
+                }
+            }
+        }
+        else {
+            control.push_back(string(buf, numbytes));
+        }
+    }
+    return true;
+}
+
+/**
+ * Wait until all the data datagrams of a round have arrived, asking
+ * senders that fall short to send their part again.
+ *
+ * @param round  Round to wait for
+ * @param expect Datagrams each group (and the coordinator) sent us
+ */
+static void dist_drain(uint32_t round, const vector<int>& expect) {
+    auto& senders = inbox[round];
+    senders.resize(dv_groups + 1);
+    for (int tries = 0; ; ) {
+        bool missing = false;
+        for (int g = 0; g <= dv_groups; g++) {
+            if ((int)senders[g].size() < expect[g]) {
+                missing = true;
+            }
+        }
+        if (!missing) {
+            return;
+        }
+        if (dist_poll(DV_TIMEOUT)) {
+            continue;
+        }
+        if (++tries > DV_RETRIES) {
+            fprintf(stderr, "distvec: gave up waiting for round %u\n", round);
+            exit(1);
+        }
+        for (int g = 0; g <= dv_groups; g++) {
+            if ((int)senders[g].size() < expect[g]) {
+                dist_control(g, PKT_NACK, round, vector<int32_t>());
+            }
+        }
+    }
+}
+
+/**
+ * Records to be sent to each group this round, batched into as few
+ * datagrams as fit.
+ */
+typedef struct outbox {
+    vector<vector<dv_record_t>> batch;  // records not yet sent, by group
+    vector<int32_t>             sent;   // datagrams sent, by group
+    long                        records;
+} outbox_t;
+
+static void outbox_flush(outbox_t& out, int to, uint32_t type, uint32_t round) {
+    vector<dv_record_t>& batch = out.batch[to];
+    for (size_t i = 0; i < batch.size(); i += DV_BATCH) {
+        uint32_t count = min(batch.size() - i, (size_t)DV_BATCH);
+        dist_send(to, type, round, out.sent[to]++, &batch[i], count, sizeof(dv_record_t));
+    }
+    out.records += batch.size();
+    batch.clear();
+}
+
+/**
+ * Hand a route of node x to the neighbors of x in this process and
+ * queue it once for every other group that has one.
+ */
+static void advertise(outbox_t& out, vector<dv_record_t>& local, int x, int d) {
+    dv_record_t record;
+    record.node = x;
+    record.dest = d;
+    record.cost = cost_row(x, x)->cost[d];
+    record.hop = nodes[x]->next_hop[d];
+
+    // a group gets the record once, however many neighbors it has
+    for (auto link : links[x]) {
+        int g = link.first % dv_groups;
+        vector<dv_record_t>& batch = g == dv_group ? local : out.batch[g];
+        if (batch.empty() || batch.back().node != x || batch.back().dest != d) {
+            batch.push_back(record);
+        }
+    }
+}
+
+/**
+ * A route from node x reaches its neighbors in this process; each
+ * keeps it in x's row of its cost table, poisoned if it goes back
+ * through that neighbor.
+ */
+static void receive(const dv_record_t& record, vector<bool>& dirty) {
+    for (auto link : links[record.node]) {
+        int y = link.first;
+        if (!owned(y)) {
+            continue;
+        }
+        cost_row_t* row = cost_row(y, record.node);
+        row->heard = true;
+        row->cost[record.dest] = record.hop == y ? dv_infinity : record.cost;
+        dirty[y] = true;
+    }
+}
+
+/**
+ * Feed every record of a round's datagrams to a function.
+ */
+template <typename F>
+static void inbox_take(uint32_t round, F f) {
+    for (auto& sender : inbox[round]) {
+        for (auto& p : sender) {
+            const dv_header_t* header = (const dv_header_t*)p.second.data();
+            const dv_record_t* records = (const dv_record_t*)(p.second.data() + sizeof(dv_header_t));
+            for (uint32_t i = 0; i < header->count; i++) {
+                f(records[i]);
+            }
+        }
+    }
+    inbox.erase(inbox.begin(), inbox.upper_bound(round));
+    inbox_floor = round + 1;
+}
+
+/**
+ * Worker process main loop: run rounds for the coordinator until told
+ * to quit.  Only the nodes of this group have tables here.
+ */
+static void dist_worker() {
+    uint32_t last_round = 0;
+    bool done_any = false;
+    vector<int32_t> done;
+    vector<bool> dirty;
+    vector<int> dests;
+
+    while (1) {
+        while (control.empty()) {
+            // don't outlive the coordinator
+            if (!dist_poll(DV_TIMEOUT) && getppid() != coordinator) {
+                return;
+            }
+        }
+        string packet = control.front();
+        control.pop_front();
+        const dv_header_t* header = (const dv_header_t*)packet.data();
+        const int32_t* args = (const int32_t*)(packet.data() + sizeof(dv_header_t));
+        uint32_t round = header->round;
+
+        if (header->type == PKT_QUIT) {
+            return;
+        }
+        // the coordinator missed our answer
+        if (done_any && round == last_round) {
+            dist_control(dv_groups, PKT_DONE, round, done);
+            continue;
+        }
+        if (done_any && round < last_round) {
+            continue;
+        }
+
+        int n = nodes.size();
+        outbox_t out;
+        out.batch.assign(dv_groups + 1, vector<dv_record_t>());
+        out.sent.assign(dv_groups + 1, 0);
+        out.records = 0;
+        dist_new_round(round);
+        int changed = 0;
+
+        if (header->type == PKT_COLLECT) {
+            // send the coordinator every reachable route we keep
+            for (int y = 0; y < n; y++) {
+                if (!owned(y)) {
+                    continue;
+                }
+                for (int d = 0; d < n; d++) {
+                    if (nodes[y]->next_hop[d] >= 0) {
+                        dv_record_t record;
+                        record.node = y;
+                        record.dest = d;
+                        record.cost = cost_row(y, y)->cost[d];
+                        record.hop = nodes[y]->next_hop[d];
+                        out.batch[dv_groups].push_back(record);
+                    }
+                }
+            }
+            outbox_flush(out, dv_groups, PKT_TABLE, round);
+        }
+        else if (args[0]) {
+            // a new epoch: apply its change, then greet new neighbors
+            // with our whole vector
+            if (args[1] >= 0) {
+                set_link(args[1], args[2], args[3]);
+            }
+            vector<vector<int>> greet;
+            dv_begin(greet);
+            n = nodes.size();
+            vector<dv_record_t> local;
+            for (int y = 0; y < n; y++) {
+                for (int x : greet[y]) {
+                    for (int d = 0; d < n; d++) {
+                        dv_record_t record;
+                        record.node = y;
+                        record.dest = d;
+                        record.cost = cost_row(y, y)->cost[d];
+                        record.hop = nodes[y]->next_hop[d];
+                        if (owned(x)) {
+                            local.push_back(record);
+                        }
+                        else {
+                            out.batch[x % dv_groups].push_back(record);
+                        }
+                    }
+                }
+            }
+            dirty.assign(n, false);
+            for (auto& record : local) {
+                receive(record, dirty);
+            }
+            // every node looks at its links once
+            for (int y = 0; y < n; y++) {
+                dirty[y] = owned(y);
+            }
+        }
+        else {
+            // take in last round's updates, then recompute
+            dist_drain(round - 1, vector<int>(args + 4, args + 4 + dv_groups + 1));
+            inbox_take(round - 1, [&](const dv_record_t& record) { receive(record, dirty); });
+
+            vector<dv_record_t> local;
+            for (int y = 0; y < n; y++) {
+                if (!dirty[y]) {
+                    continue;
+                }
+                dirty[y] = false;
+                if (dv_update(y, dests)) {
+                    changed++;
+                    for (int d : dests) {
+                        advertise(out, local, y, d);
+                    }
+                }
+            }
+            // everyone advertises at once at the end of the round
+            for (auto& record : local) {
+                receive(record, dirty);
+            }
+        }
+
+        for (int g = 0; g < dv_groups; g++) {
+            outbox_flush(out, g, PKT_UPDATE, round);
+        }
+        done.assign(1, changed);
+        done.push_back(resent);
+        done.push_back(out.records);
+        done.insert(done.end(), out.sent.begin(), out.sent.end());
+        dist_control(dv_groups, PKT_DONE, round, done);
+        last_round = round;
+        done_any = true;
+    }
+}
+
+/**
+ * Split the nodes into groups and fork one worker process for each,
+ * all talking UDP on localhost.  The calling process becomes the
+ * coordinator and returns; the workers never do.
+ *
+ * @param procs Number of worker processes
+ */
+void dist_start(int procs) {
+    dv_groups = procs;
+    group_addr.resize(procs + 1);
+    for (int g = 0; g <= procs; g++) {
+        memset(&group_addr[g], 0, sizeof(struct sockaddr_in));
+        group_addr[g].sin_family = AF_INET;
+        group_addr[g].sin_port = htons(DV_PORT + g);
+        group_addr[g].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    // nothing buffered may be written twice
+    cout.flush();
+    fflush(stdout);
+    outfile.flush();
+
+    coordinator = getpid();
+    for (int g = 0; g < procs; g++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("distvec: fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            dv_group = g;
+            workers.clear();
+            dist_socket(g);
+            dist_worker();
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+    dv_group = procs;
+    dist_socket(procs);
+}
+
+/**
+ * Queue a topology change for the workers; it goes out with the first
+ * round of the next epoch.
+ */
+void dist_change(int src, int dest, int cost) {
+    change_src = src;
+    change_dest = dest;
+    change_cost = cost;
+}
+
+/**
+ * Send a control datagram to every worker and wait for all of them to
+ * answer, sending it again to any that stay quiet.
+ *
+ * @param payload Control payload, per worker
+ * @param done    Filled with each worker's DONE payload
+ */
+static void dist_round(uint32_t type, uint32_t round, const vector<vector<int32_t>>& payload, vector<vector<int32_t>>& done) {
+    done.assign(dv_groups, vector<int32_t>());
+    int waiting = dv_groups;
+    for (int g = 0; g < dv_groups; g++) {
+        dist_control(g, type, round, payload[g]);
+    }
+    for (int tries = 0; waiting > 0; ) {
+        while (!control.empty()) {
+            string packet = control.front();
+            control.pop_front();
+            const dv_header_t* header = (const dv_header_t*)packet.data();
+            const int32_t* args = (const int32_t*)(packet.data() + sizeof(dv_header_t));
+            if (header->type == PKT_DONE && header->round == round && done[header->from].empty()) {
+                done[header->from].assign(args, args + header->count);
+                waiting--;
+            }
+        }
+        if (waiting == 0 || dist_poll(DV_TIMEOUT)) {
+            continue;
+        }
+        if (++tries > DV_RETRIES) {
+            fprintf(stderr, "distvec: workers stopped answering in round %u\n", round);
+            exit(1);
+        }
+        for (int g = 0; g < dv_groups; g++) {
+            if (done[g].empty()) {
+                dist_control(g, type, round, payload[g]);
+            }
+        }
+    }
+}
+
+/**
+ * Run distance vector across the worker processes until it converges,
+ * then collect every node's vector back so the tables can be written
+ * out as usual.  Each round the coordinator tells every worker how many
+ * updates to wait for; the workers recompute their dirty nodes and send
+ * only the routes that changed, batched into one stream of datagrams
+ * per group.
+ *
+ * @param stats Filled with the rounds and datagrams it took
+ */
+void dist_converge(convergence_t& stats) {
+    auto start = chrono::steady_clock::now();
+    number_nodes();
+    read_links();
+    stats.rounds = 0;
+    stats.messages = 0;
+    long records = 0, resends = 0;
+    static long resends_before = 0;
+
+    // the first round carries the change; later ones how many
+    // datagrams each group was sent the round before
+    vector<vector<int32_t>> payload(dv_groups, vector<int32_t>(4 + dv_groups + 1, 0)), done;
+    for (auto& p : payload) {
+        p[0] = 1;
+        p[1] = change_src;
+        p[2] = change_dest;
+        p[3] = change_cost;
+    }
+    change_src = -1;
+
+    bool begin = true;
+    while (1) {
+        dist_round(PKT_ROUND, ++clock_round, payload, done);
+        long changed = 0;
+        resends = 0;
+        for (int g = 0; g < dv_groups; g++) {
+            changed += done[g][0];
+            resends += done[g][1];
+            records += done[g][2];
+            for (int to = 0; to <= dv_groups; to++) {
+                stats.messages += done[g][3 + to];
+            }
+            for (int to = 0; to < dv_groups; to++) {
+                payload[to][0] = 0;
+                payload[to][4 + g] = done[g][3 + to];
+            }
+        }
+        if (!begin && changed == 0) {
+            break;
+        }
+        if (!begin) {
+            stats.rounds++;
+        }
+        begin = false;
+    }
+
+    // collect the converged vectors
+    vector<vector<int32_t>> empty(dv_groups);
+    dist_round(PKT_COLLECT, ++clock_round, empty, done);
+    vector<int> expect(dv_groups + 1, 0);
+    for (int g = 0; g < dv_groups; g++) {
+        expect[g] = done[g][3 + dv_groups];
+    }
+    dist_drain(clock_round, expect);
+
+    own_rows_only();
+    inbox_take(clock_round, [&](const dv_record_t& record) {
+        cost_row(record.node, record.node)->cost[record.dest] = record.cost;
+        nodes[record.node]->next_hop[record.dest] = record.hop;
+    });
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Distance vector: " << dv_groups << " processes converged in " << stats.rounds
+         << " rounds, " << stats.messages << " datagrams carrying " << records << " routes, "
+         << resends - resends_before << " resent, " << ms << " ms ("
+         << (ms > 0 ? stats.messages * 1000 / ms : 0) << " datagrams/s)" << endl;
+    resends_before = resends;
+}
+
+/**
+ * Tell the workers to quit and wait for them.
+ */
+void dist_stop() {
+    uint32_t round = ++clock_round;
+    int running = workers.size();
+    while (running > 0) {
+        for (int g = 0; g < dv_groups; g++) {
+            if (workers[g] > 0) {
+                dist_control(g, PKT_QUIT, round, vector<int32_t>());
+            }
+        }
+        usleep(DV_TIMEOUT * 1000);
+        for (int g = 0; g < dv_groups; g++) {
+            if (workers[g] > 0 && waitpid(workers[g], NULL, WNOHANG) == workers[g]) {
+                workers[g] = 0;
+                running--;
+            }
+        }
+    }
+    close(sockfd);
+}
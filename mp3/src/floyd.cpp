@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+#include "graph.h"
+
+using namespace std;
+
+// tile edge length; three 64x64 int tiles fit in L1/L2 together
+#define TILE 64
+// "no path" marker; INF + INF still fits in an int
+#define INF (INT_MAX / 2)
+
+/**
+ * Run body(0) .. body(count - 1) on up to `threads` workers, which
+ * claim indices from a shared counter.  Returns once all are done.
+ */
+void parallel_for(int count, int threads, const function<void(int)>& body) {
+    threads = min(threads, count);
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    atomic<int> next(0);
+    auto worker = [&]() {
+        int i;
+        while ((i = next++) < count) {
+            body(i);
+        }
+    };
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.push_back(thread(worker));
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+/**
+ * Portable min-plus tile kernel: c[i][j] = min(c[i][j], a[i][k] + b[k][j]).
+ * k is the outer loop so the kernel stays correct when c aliases a or b,
+ * as it does for the diagonal, row and column tiles.
+ */
+static void minplus_scalar(int* c, const int* a, const int* b, int stride) {
+    for (int k = 0; k < TILE; k++) {
+        const int* bk = b + k * stride;
+        for (int i = 0; i < TILE; i++) {
+            int aik = a[i * stride + k];
+            if (aik >= INF) {
+                continue;
+            }
+            int* ci = c + i * stride;
+            for (int j = 0; j < TILE; j++) {
+                ci[j] = min(ci[j], aik + bk[j]);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/**
+ * AVX2 version of minplus_scalar(), eight columns per instruction.
+ */
+__attribute__((target("avx2")))
+static void minplus_avx2(int* c, const int* a, const int* b, int stride) {
+    for (int k = 0; k < TILE; k++) {
+        const int* bk = b + k * stride;
+        for (int i = 0; i < TILE; i++) {
+            int aik = a[i * stride + k];
+            if (aik >= INF) {
+                continue;
+            }
+            __m256i va = _mm256_set1_epi32(aik);
+            int* ci = c + i * stride;
+            for (int j = 0; j < TILE; j += 8) {
+                __m256i sum = _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + j)));
+                __m256i cur = _mm256_loadu_si256((const __m256i*)(ci + j));
+                _mm256_storeu_si256((__m256i*)(ci + j), _mm256_min_epi32(cur, sum));
+            }
+        }
+    }
+}
+
+/**
+ * AVX2 kernel for tiles that alias neither input (phase 3).  A whole
+ * 64-column row of c stays in eight registers while k runs, so c is
+ * loaded and stored once per row instead of once per k.
+ */
+__attribute__((target("avx2")))
+static void minplus_avx2_rows(int* c, const int* a, const int* b, int stride) {
+    for (int i = 0; i < TILE; i++) {
+        int* ci = c + i * stride;
+        const int* ai = a + i * stride;
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(ci + 0));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(ci + 8));
+        __m256i r2 = _mm256_loadu_si256((const __m256i*)(ci + 16));
+        __m256i r3 = _mm256_loadu_si256((const __m256i*)(ci + 24));
+        __m256i r4 = _mm256_loadu_si256((const __m256i*)(ci + 32));
+        __m256i r5 = _mm256_loadu_si256((const __m256i*)(ci + 40));
+        __m256i r6 = _mm256_loadu_si256((const __m256i*)(ci + 48));
+        __m256i r7 = _mm256_loadu_si256((const __m256i*)(ci + 56));
+        for (int k = 0; k < TILE; k++) {
+            if (ai[k] >= INF) {
+                continue;
+            }
+            __m256i va = _mm256_set1_epi32(ai[k]);
+            const int* bk = b + k * stride;
+            r0 = _mm256_min_epi32(r0, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 0))));
+            r1 = _mm256_min_epi32(r1, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 8))));
+            r2 = _mm256_min_epi32(r2, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 16))));
+            r3 = _mm256_min_epi32(r3, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 24))));
+            r4 = _mm256_min_epi32(r4, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 32))));
+            r5 = _mm256_min_epi32(r5, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 40))));
+            r6 = _mm256_min_epi32(r6, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 48))));
+            r7 = _mm256_min_epi32(r7, _mm256_add_epi32(va, _mm256_loadu_si256((const __m256i*)(bk + 56))));
+        }
+        _mm256_storeu_si256((__m256i*)(ci + 0), r0);
+        _mm256_storeu_si256((__m256i*)(ci + 8), r1);
+        _mm256_storeu_si256((__m256i*)(ci + 16), r2);
+        _mm256_storeu_si256((__m256i*)(ci + 24), r3);
+        _mm256_storeu_si256((__m256i*)(ci + 32), r4);
+        _mm256_storeu_si256((__m256i*)(ci + 40), r5);
+        _mm256_storeu_si256((__m256i*)(ci + 48), r6);
+        _mm256_storeu_si256((__m256i*)(ci + 56), r7);
+    }
+}
+#endif
+
+/**
+ * Compute all-pairs path costs with a cache-blocked Floyd-Warshall.
+ * Each round k updates the diagonal tile, then the tiles in row and
+ * column k (in parallel), then every remaining tile (in parallel).
+ *
+ * @param graph   Graph to search
+ * @param dist    Filled with the n x n cost matrix, row-major with
+ *                stride `stride`; unreachable pairs are >= INF
+ * @param stride  Set to the padded row length of dist
+ * @param threads Number of worker threads to use
+ */
+void floyd_warshall(const graph_t& graph, vector<int>& dist, int& stride, int threads) {
+    int n = graph.ids.size();
+    int blocks = (n + TILE - 1) / TILE;
+    stride = blocks * TILE;
+
+    dist.assign((size_t)stride * stride, INF);
+    for (int i = 0; i < stride; i++) {
+        dist[(size_t)i * stride + i] = 0;
+    }
+    for (int u = 0; u < n; u++) {
+        for (int e = graph.offset[u]; e < graph.offset[u + 1]; e++) {
+            if (graph.adj[e] != u) {
+                dist[(size_t)u * stride + graph.adj[e]] = graph.cost[e];
+            }
+        }
+    }
+
+    // pick the kernels once; phase 3 tiles never alias their inputs
+    void (*minplus)(int*, const int*, const int*, int) = minplus_scalar;
+    void (*minplus_rows)(int*, const int*, const int*, int) = minplus_scalar;
+#ifdef HAVE_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2")) {
+        minplus = minplus_avx2;
+        minplus_rows = minplus_avx2_rows;
+    }
+#endif
+
+    int* d = dist.data();
+    auto tile = [&](int bi, int bj) {
+        return d + (size_t)bi * TILE * stride + (size_t)bj * TILE;
+    };
+
+    for (int k = 0; k < blocks; k++) {
+        // phase 1: the diagonal tile depends only on itself
+        minplus(tile(k, k), tile(k, k), tile(k, k), stride);
+
+        // phase 2: row k and column k depend on the diagonal tile
+        parallel_for(2 * blocks, threads, [&](int t) {
+            int j = t / 2;
+            if (j == k) {
+                return;
+            }
+            if (t % 2 == 0) {
+                minplus(tile(k, j), tile(k, k), tile(k, j), stride);
+            }
+            else {
+                minplus(tile(j, k), tile(j, k), tile(k, k), stride);
+            }
+        });
+
+        // phase 3: every other tile depends on its row and column tiles
+        parallel_for(blocks * blocks, threads, [&](int t) {
+            int i = t / blocks, j = t % blocks;
+            if (i == k || j == k) {
+                return;
+            }
+            minplus_rows(tile(i, j), tile(i, k), tile(k, j), stride);
+        });
+    }
+}
+
+/**
+ * Rebuild the shortest path tree of one source from its row of the
+ * all-pairs cost matrix.  Each node's parent is its lowest ID
+ * neighbor lying on a shortest path, which is the same tie-breaking
+ * Dijkstra() applies, so the resulting tables are identical.
+ *
+ * @param graph  Graph the costs were computed on
+ * @param source Dense index of the root
+ * @param row    Cost row of the source, unreachable entries >= INF
+ * @param tree   Tree to fill
+ */
+void tree_from_costs(const graph_t& graph, int source, const int* row, spt_t& tree) {
+    int n = graph.ids.size();
+    tree.dist.assign(n, -1);
+    tree.parent.assign(n, -1);
+    tree.next_hop.assign(n, -1);
+
+    for (int v = 0; v < n; v++) {
+        if (row[v] >= INF) {
+            continue;
+        }
+        tree.dist[v] = row[v];
+        if (v == source) {
+            tree.dist[v] = 0;
+            tree.parent[v] = source;
+            continue;
+        }
+        // rows are sorted, so the first match has the lowest ID
+        for (int e = graph.offset[v]; e < graph.offset[v + 1]; e++) {
+            int u = graph.adj[e];
+            if (u != v && row[u] < INF && row[u] + graph.cost[e] == row[v]) {
+                tree.parent[v] = u;
+                break;
+            }
+        }
+    }
+
+    // next hops: walk up to a node whose hop is known, then unwind
+    tree.next_hop[source] = source;
+    vector<int> path;
+    for (int v = 0; v < n; v++) {
+        if (tree.dist[v] < 0 || tree.next_hop[v] >= 0) {
+            continue;
+        }
+        int u = v;
+        while (tree.next_hop[u] < 0 && tree.parent[u] != source) {
+            path.push_back(u);
+            u = tree.parent[u];
+        }
+        if (tree.next_hop[u] < 0) {
+            tree.next_hop[u] = u;
+        }
+        int hop = tree.next_hop[u];
+        while (!path.empty()) {
+            tree.next_hop[path.back()] = hop;
+            path.pop_back();
+        }
+    }
+}
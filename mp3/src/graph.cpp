@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+using namespace std;
+
+/**
+ * Build a dense snapshot of a topology map.  Nodes are numbered
+ * in the map's (ascending ID) order and each adjacency row is
+ * sorted by neighbor index.
+ *
+ * @param topo  Topology map to copy
+ * @param graph Graph to fill
+ */
+void build_graph(map<int, node_t*>& topo, graph_t& graph) {
+    graph.ids.clear();
+    graph.index.clear();
+    graph.offset.clear();
+    graph.adj.clear();
+    graph.cost.clear();
+
+    // number the nodes in ID order
+    for (auto p : topo) {
+        graph.index[p.first] = graph.ids.size();
+        graph.ids.push_back(p.first);
+    }
+
+    // copy each neighbor list, sorted by dense index
+    vector<pair<int, int>> row;
+    graph.offset.push_back(0);
+    for (auto p : topo) {
+        row.clear();
+        for (auto neighbor : p.second->neighbors) {
+            row.push_back(make_pair(graph.index[neighbor.first], neighbor.second));
+        }
+        sort(row.begin(), row.end());
+        for (auto link : row) {
+            graph.adj.push_back(link.first);
+            graph.cost.push_back(link.second);
+        }
+        graph.offset.push_back(graph.adj.size());
+    }
+}
+
+/**
+ * Look up the cost of the link between two nodes.
+ *
+ * @param graph Graph to search
+ * @param a     Dense index of one end of the link
+ * @param b     Dense index of the other end
+ * @return      Link cost, or -1 if the nodes are not neighbors
+ */
+int link_cost(const graph_t& graph, int a, int b) {
+    auto first = graph.adj.begin() + graph.offset[a];
+    auto last = graph.adj.begin() + graph.offset[a + 1];
+    auto it = lower_bound(first, last, b);
+    if (it == last || *it != b) {
+        return -1;
+    }
+    return graph.cost[it - graph.adj.begin()];
+}
+
+/**
+ * Compute the shortest path tree rooted at a node with a binary
+ * heap Dijkstra.  Equal-cost paths are resolved exactly as in
+ * Dijkstra(): a node's parent is its lowest ID predecessor, and
+ * its next hop is inherited from that parent.
+ *
+ * @param graph  Graph to search
+ * @param source Dense index of the root
+ * @param tree   Tree to fill
+ */
+void shortest_path_tree(const graph_t& graph, int source, spt_t& tree) {
+    int n = graph.ids.size();
+    tree.dist.assign(n, INT_MAX);
+    tree.parent.assign(n, -1);
+    tree.next_hop.assign(n, -1);
+    // scratch kept per thread, so back-to-back sources reuse it
+    static thread_local vector<bool> done;
+    done.assign(n, false);
+
+    // min-heap of <path cost, node>, so equal costs pop in ID order
+    static thread_local vector<pair<int, int>> heap;
+    greater<pair<int, int>> later;
+    heap.clear();
+    tree.dist[source] = 0;
+    tree.parent[source] = source;
+    heap.push_back(make_pair(0, source));
+
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), later);
+        int u = heap.back().second;
+        heap.pop_back();
+        if (done[u]) {
+            continue;
+        }
+        done[u] = true;
+
+        // the parent was finished first, so its next hop is known
+        if (u == source) {
+            tree.next_hop[u] = source;
+        }
+        else if (tree.parent[u] == source) {
+            tree.next_hop[u] = u;
+        }
+        else {
+            tree.next_hop[u] = tree.next_hop[tree.parent[u]];
+        }
+
+        for (int i = graph.offset[u]; i < graph.offset[u + 1]; i++) {
+            int v = graph.adj[i];
+            if (done[v]) {
+                continue;
+            }
+            int w = tree.dist[u] + graph.cost[i];
+            if (w < tree.dist[v]) {
+                tree.dist[v] = w;
+                tree.parent[v] = u;
+                heap.push_back(make_pair(w, v));
+                push_heap(heap.begin(), heap.end(), later);
+            }
+            // tiebreaking -- keep the predecessor with the smaller ID
+            else if (w == tree.dist[v] && u < tree.parent[v]) {
+                tree.parent[v] = u;
+            }
+        }
+    }
+
+    // mark anything never reached as unreachable
+    for (int i = 0; i < n; i++) {
+        if (!done[i]) {
+            tree.dist[i] = -1;
+        }
+    }
+}
+
+/**
+ * Largest link cost in a graph.
+ */
+int max_link_cost(const graph_t& graph) {
+    int max_cost = 0;
+    for (int c : graph.cost) {
+        max_cost = max(max_cost, c);
+    }
+    return max_cost;
+}
+
+/**
+ * Compute the shortest path tree rooted at a node with Dial's bucket
+ * queue instead of a heap.  With positive integer costs of at most C,
+ * every tentative cost lies within C of the one being settled, so C + 1
+ * circular buckets are enough.  Each bucket is settled in ID order, the
+ * same order the heap pops equal costs, and ties are broken as in
+ * shortest_path_tree().
+ *
+ * @param graph    Graph to search
+ * @param source   Dense index of the root
+ * @param max_cost Largest link cost in the graph
+ * @param tree     Tree to fill
+ */
+void bucket_tree(const graph_t& graph, int source, int max_cost, spt_t& tree) {
+    int n = graph.ids.size();
+    tree.dist.assign(n, INT_MAX);
+    tree.parent.assign(n, -1);
+    tree.next_hop.assign(n, -1);
+    static thread_local vector<bool> done;
+    done.assign(n, false);
+
+    // every bucket is empty again once a search finishes
+    int width = max_cost + 1;
+    static thread_local vector<vector<int>> buckets;
+    if ((int)buckets.size() < width) {
+        buckets.resize(width);
+    }
+    tree.dist[source] = 0;
+    tree.parent[source] = source;
+    buckets[0].push_back(source);
+    int pending = 1;    // bucket entries not yet taken out, including stale ones
+
+    static thread_local vector<int> bucket;
+    bucket.clear();
+    for (int d = 0; pending > 0; d++) {
+        bucket.swap(buckets[d % width]);
+        if (bucket.empty()) {
+            continue;
+        }
+        pending -= bucket.size();
+        sort(bucket.begin(), bucket.end());
+
+        for (int u : bucket) {
+            // skip duplicates and entries left behind by a cheaper path
+            if (done[u] || tree.dist[u] != d) {
+                continue;
+            }
+            done[u] = true;
+
+            if (u == source) {
+                tree.next_hop[u] = source;
+            }
+            else if (tree.parent[u] == source) {
+                tree.next_hop[u] = u;
+            }
+            else {
+                tree.next_hop[u] = tree.next_hop[tree.parent[u]];
+            }
+
+            for (int i = graph.offset[u]; i < graph.offset[u + 1]; i++) {
+                int v = graph.adj[i];
+                if (done[v]) {
+                    continue;
+                }
+                int w = d + graph.cost[i];
+                if (w < tree.dist[v]) {
+                    tree.dist[v] = w;
+                    tree.parent[v] = u;
+                    buckets[w % width].push_back(v);
+                    pending++;
+                }
+                // tiebreaking -- keep the predecessor with the smaller ID
+                else if (w == tree.dist[v] && u < tree.parent[v]) {
+                    tree.parent[v] = u;
+                }
+            }
+        }
+        bucket.clear();
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!done[i]) {
+            tree.dist[i] = -1;
+        }
+    }
+}
+
+/**
+ * Convert a shortest path tree into a routing table with one
+ * entry per node, in ID order, matching the output of Dijkstra().
+ *
+ * @param graph  Graph the tree was computed on
+ * @param source Dense index of the root
+ * @param tree   Tree rooted at source
+ * @param table  Routing table to be filled for the root
+ */
+void tree_to_table(const graph_t& graph, int source, const spt_t& tree, vector<entry_t>& table) {
+    int n = graph.ids.size();
+    table.resize(n);
+    for (int i = 0; i < n; i++) {
+        table[i].dest = graph.ids[i];
+        table[i].path_cost = tree.dist[i];
+        table[i].next_hop = tree.next_hop[i] < 0 ? -1 : graph.ids[tree.next_hop[i]];
+    }
+    table[source].path_cost = 0;
+    table[source].next_hop = graph.ids[source];
+}
@@ -0,0 +1,144 @@
+#ifndef _GRAPH_H
+#define _GRAPH_H
+
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "routing.h"
+
+using namespace std;
+
+/**
+ * Dense Graph Struct
+ *   Read-only snapshot of the topology with node IDs renumbered
+ *   0..N-1 in ascending ID order, so comparing dense indices gives
+ *   the same tie-breaking as comparing node IDs.  Adjacency is kept
+ *   in compressed sparse row form with each row sorted by neighbor.
+ */
+typedef struct dense_graph {
+    vector<int>             ids;        // dense index -> node ID
+    unordered_map<int, int> index;      // node ID -> dense index
+    vector<int>             offset;     // row i is adj[offset[i] .. offset[i+1])
+    vector<int>             adj;        // neighbor dense indices
+    vector<int>             cost;       // link cost, parallel to adj
+} graph_t;
+
+/**
+ * Shortest Path Tree Struct
+ *   Result of a single-source shortest path computation, indexed
+ *   by dense node index.  The parent of every node is the lowest
+ *   ID predecessor among its equal-cost shortest paths, which is
+ *   the tie-breaking rule Dijkstra() applies.
+ */
+typedef struct shortest_path_tree {
+    vector<int>     dist;       // path cost from the root, -1 if unreachable
+    vector<int>     parent;     // previous node on the path, -1 if unreachable
+    vector<int>     next_hop;   // first hop from the root, -1 if unreachable
+} spt_t;
+
+/**
+ * Landmark Struct
+ *   ALT lower-bound data: exact path costs from a few landmark
+ *   nodes to every node, computed once per topology.
+ */
+typedef struct landmarks {
+    vector<vector<int>> dist;   // dist[l][v], -1 if unreachable
+} landmarks_t;
+
+/**
+ * Point-to-Point Query Struct
+ *   Scratch state for routing single messages without full trees.
+ *   Arrays are validated by a generation stamp instead of being
+ *   cleared, so a query only touches the nodes it visits.
+ */
+typedef struct p2p_query {
+    const graph_t*      graph;      // graph being queried
+    landmarks_t         landmarks;  // empty for plain bidirectional search
+    unsigned            gen;        // stamp of the current search
+    vector<unsigned>    seen_f;     // dist_f valid when == gen
+    vector<unsigned>    seen_b;     // dist_b valid when == gen
+    vector<unsigned>    done_f;     // settled by the forward search
+    vector<unsigned>    done_b;     // settled by the backward search
+    vector<unsigned>    seen_r;     // dist_r valid when == gen
+    vector<int>         dist_f;     // cost from the source
+    vector<int>         dist_b;     // cost to the destination
+    vector<int>         dist_r;     // cost from the current hop
+    vector<int>         region;     // nodes settled by either direction
+} p2p_t;
+
+/**
+ * Locality Ordering Struct
+ *   Shared renumbering of the destinations used by compressed tables,
+ *   chosen so that nodes reached through the same next hop tend to be
+ *   contiguous.
+ */
+typedef struct locality_order {
+    vector<int>     pos;        // dense index -> position in the order
+    vector<int>     node;       // position -> dense index
+} order_t;
+
+/**
+ * Compressed Routing Table Struct
+ *   One node's routing table over the locality ordering.  Consecutive
+ *   destinations with the same next hop share one run.  Path costs are
+ *   recovered along the path from the small per-run link costs.
+ */
+typedef struct compact_table {
+    vector<int>     run_start;  // first position of each run, ascending
+    vector<int>     run_hop;    // next hop (dense index) of each run, -1 if unreachable
+    vector<int>     run_cost;   // cost of the link to run_hop, 0 for the node itself
+} ctable_t;
+
+/**
+ * Link Failure Impact Struct
+ *   What happens to the routes if one link goes down.  Every routing
+ *   table follows its owner's shortest path tree, so the routes that
+ *   change are the (src, dest) pairs whose tree path uses the link.
+ */
+typedef struct link_impact {
+    int         a;              // dense index of the lower end
+    int         b;              // dense index of the upper end
+    int         cost;           // link cost
+    long        routes;         // (src, dest) pairs routed over the link
+    long        costlier;       // of those, pairs whose path cost goes up
+    long        unreachable;    // of those, pairs left with no path at all
+    long long   added;          // total cost increase of the costlier pairs
+    int         max_added;      // largest single cost increase
+} impact_t;
+
+/**
+ * Scheduler Report Struct
+ *   How a steal_for() run went, for the utilization report.
+ */
+typedef struct sched_report {
+    int             chunks;     // chunks the work was cut into
+    double          wall_ms;    // time until the last worker finished
+    vector<double>  busy_ms;    // per thread: time spent running tasks
+    vector<int>     tasks;      // per thread: tasks run
+    vector<int>     steals;     // per thread: chunks taken from other threads
+} sched_report_t;
+
+void build_graph(map<int, node_t*>& topo, graph_t& graph);
+int link_cost(const graph_t& graph, int a, int b);
+void shortest_path_tree(const graph_t& graph, int source, spt_t& tree);
+int max_link_cost(const graph_t& graph);
+void bucket_tree(const graph_t& graph, int source, int max_cost, spt_t& tree);
+void tree_to_table(const graph_t& graph, int source, const spt_t& tree, vector<entry_t>& table);
+void floyd_warshall(const graph_t& graph, vector<int>& dist, int& stride, int threads);
+void tree_from_costs(const graph_t& graph, int source, const int* row, spt_t& tree);
+void select_landmarks(const graph_t& graph, int count, landmarks_t& lm);
+void p2p_init(p2p_t& q, const graph_t& graph, int landmarks);
+int p2p_route(p2p_t& q, int src, int dest, vector<int>& hops);
+void locality_order(const graph_t& graph, order_t& order);
+void compress_table(const graph_t& graph, const order_t& order, int source, const vector<entry_t>& table, ctable_t& ct);
+int compact_lookup(const ctable_t& ct, const order_t& order, int dest, int& link);
+size_t compact_bytes(const ctable_t& ct);
+void parallel_for(int count, int threads, const function<void(int)>& body);
+void source_costs(const graph_t& graph, vector<long>& cost);
+void steal_for(const vector<long>& cost, int threads, const function<void(int, int)>& body, sched_report_t& report);
+void sched_print(const char* what, const sched_report_t& report);
+void link_failures(const graph_t& graph, bool buckets, int threads, vector<impact_t>& impact);
+
+#endif /* _GRAPH_H */
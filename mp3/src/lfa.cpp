@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "linkstate.h"
+#include "stream.h"
+
+using namespace std;
+
+// topology and tables the backups were computed for, by dense index;
+// like the tables themselves, these are per batch scenario thread
+static thread_local graph_t lfa_graph;
+static thread_local vector<vector<entry_t>*> lfa_rows;
+
+/**
+ * Backup Struct
+ *   The backup for one route, kept beside the routing tables so that
+ *   entries only grow when --lfa is on.  Both are dense indices.
+ */
+typedef struct backup {
+    int         hop;            // backup next hop, -1 if none
+    int         tunnel;         // remote LFA node backup traffic is tunneled to, -1 if none
+} backup_t;
+
+// backup of every route, by dense source and destination index
+static thread_local vector<vector<backup_t>> lfa_backups;
+
+// fast reroute bookkeeping between a link failure and the recompute
+static thread_local bool rerouting = false;
+static thread_local chrono::steady_clock::time_point reroute_start;
+static thread_local int reroute_failed, reroute_messages, reroute_backups, reroute_dropped;
+
+/**
+ * Path cost between two nodes (dense indices) from the current tables.
+ */
+static int table_cost(int a, int b) {
+    return (*lfa_rows[a])[b].path_cost;
+}
+
+/**
+ * Pick the backup for one route.  A neighbor N other than the primary
+ * hop is a loop-free alternate for dest if its own shortest path to
+ * dest cannot lead back through the source:
+ *     cost(N, dest) < cost(N, source) + cost(source, dest)
+ * The cheapest such neighbor wins, lowest ID on ties.
+ *
+ * @return Dense index of the alternate, -1 if there is none
+ */
+static int find_lfa(int source, int primary, int dest) {
+    const graph_t& g = lfa_graph;
+    int best = -1;
+    long best_cost = 0;
+    for (int e = g.offset[source]; e < g.offset[source + 1]; e++) {
+        int n = g.adj[e];
+        if (n == primary) {
+            continue;
+        }
+        int to_dest = table_cost(n, dest);
+        int to_source = table_cost(n, source);
+        if (to_dest < 0 || to_source < 0 || to_dest >= to_source + table_cost(source, dest)) {
+            continue;
+        }
+        long cost = (long)g.cost[e] + to_dest;
+        if (best < 0 || cost < best_cost) {
+            best = n;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+/**
+ * Remote LFA candidates for losing the link from source to primary:
+ * nodes the source still reaches without that link (its P-space,
+ * routes whose first hop is not primary) that reach primary without
+ * passing through the source (its Q-space), cheapest first.
+ */
+static void pq_nodes(int source, int primary, vector<int>& pq) {
+    int n = lfa_graph.ids.size();
+    int link = link_cost(lfa_graph, source, primary);
+    vector<pair<long, int>> found;
+    for (int y = 0; y < n; y++) {
+        const entry_t& route = (*lfa_rows[source])[y];
+        if (y == source || route.path_cost < 0 || lfa_graph.index[route.next_hop] == primary) {
+            continue;
+        }
+        int to_primary = table_cost(y, primary);
+        if (to_primary >= 0 && to_primary < table_cost(y, source) + link) {
+            found.push_back(make_pair((long)route.path_cost + to_primary, y));
+        }
+    }
+    sort(found.begin(), found.end());
+    pq.clear();
+    for (auto& f : found) {
+        pq.push_back(f.second);
+    }
+}
+
+/**
+ * Compute the backup next hop of every route in the current tables
+ * and print how many routes are protected.  Routes with no loop-free
+ * alternate fall back to a remote LFA: the first PQ node of their
+ * primary link that also reaches dest without passing through the
+ * source.  Backups only read the tables, so this is one pass of
+ * O(degree) work per route, plus one O(N) PQ scan per protected link.
+ */
+void lfa_tables() {
+    if (rerouting) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - reroute_start).count();
+        cout << "Fast reroute: " << reroute_failed << " failed link(s), "
+             << reroute_backups << " of " << reroute_messages
+             << " messages delivered over backups and " << reroute_dropped
+             << " dropped while recomputing for " << ms << " ms" << endl;
+        rerouting = false;
+    }
+
+    build_graph(topology, lfa_graph);
+    int n = lfa_graph.ids.size();
+    lfa_rows.assign(n, NULL);
+    for (int i = 0; i < n; i++) {
+        lfa_rows[i] = &routing_table[lfa_graph.ids[i]];
+    }
+
+    long routes = 0, local = 0, remote = 0;
+    vector<vector<int>> pq(n);
+    vector<bool> pq_done(n);
+    lfa_backups.resize(n);
+    for (int s = 0; s < n; s++) {
+        vector<entry_t>& table = *lfa_rows[s];
+        fill(pq_done.begin(), pq_done.end(), false);
+        lfa_backups[s].assign(n, backup_t{-1, -1});
+
+        for (int d = 0; d < n; d++) {
+            const entry_t& route = table[d];
+            backup_t& backup = lfa_backups[s][d];
+            if (d == s || route.path_cost < 0) {
+                continue;
+            }
+            routes++;
+            int primary = lfa_graph.index[route.next_hop];
+
+            int alt = find_lfa(s, primary, d);
+            if (alt >= 0) {
+                backup.hop = alt;
+                local++;
+                continue;
+            }
+
+            if (!pq_done[primary]) {
+                pq_nodes(s, primary, pq[primary]);
+                pq_done[primary] = true;
+            }
+            for (int y : pq[primary]) {
+                int to_dest = table_cost(y, d);
+                if (to_dest >= 0 && to_dest < table_cost(y, s) + route.path_cost) {
+                    backup.hop = lfa_graph.index[table[y].next_hop];
+                    backup.tunnel = y;
+                    remote++;
+                    break;
+                }
+            }
+        }
+    }
+
+    cout << "LFA coverage: " << local + remote << " of " << routes << " routes protected ("
+         << local << " loop-free alternates, " << remote << " remote LFAs, "
+         << routes - local - remote << " unprotected)" << endl;
+}
+
+/**
+ * Cost of a link in the live topology, -1 if it is down.
+ */
+static int live_cost(int a, int b) {
+    auto& neighbors = topology[lfa_graph.ids[a]]->neighbors;
+    auto it = neighbors.find(lfa_graph.ids[b]);
+    return it == neighbors.end() ? -1 : it->second;
+}
+
+/**
+ * Forward a message through the tables over the live topology.  A hop
+ * whose primary link is down sends it to its backup instead; a remote
+ * LFA backup tunnels it to the PQ node, which then forwards it on
+ * normally.  With no failed links this is exactly trace_route().
+ *
+ * @param src  Source node ID
+ * @param dest Destination node ID
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, -1 if dest is unreachable, -2 if src has no table
+ */
+int lfa_trace(int src, int dest, queue<int>& hops) {
+    auto s = lfa_graph.index.find(src);
+    auto d = lfa_graph.index.find(dest);
+    if (s == lfa_graph.index.end()) {
+        return -2;
+    }
+    if (d == lfa_graph.index.end() || table_cost(s->second, d->second) < 0) {
+        return -1;
+    }
+
+    int n = lfa_graph.ids.size();
+    int cur = s->second, target = d->second, cost = 0;
+    bool backup = false;
+    hops.push(src);
+    for (int steps = 0; cur != d->second; steps++) {
+        // give up on a forwarding loop
+        if (steps > n) {
+            return -1;
+        }
+        // the PQ node takes the message out of the tunnel
+        if (cur == target) {
+            target = d->second;
+        }
+        const entry_t& route = (*lfa_rows[cur])[target];
+        if (route.next_hop < 0) {
+            return -1;
+        }
+        int next = lfa_graph.index[route.next_hop];
+        int link = live_cost(cur, next);
+        if (link < 0) {
+            const backup_t& alt = lfa_backups[cur][target];
+            if (alt.hop < 0) {
+                if (rerouting) {
+                    reroute_dropped++;
+                }
+                return -1;
+            }
+            if (alt.tunnel >= 0) {
+                target = alt.tunnel;
+            }
+            next = alt.hop;
+            link = live_cost(cur, next);
+            if (link < 0) {
+                return -1;
+            }
+            backup = true;
+        }
+        cost += link;
+        cur = next;
+        if (cur != d->second) {
+            hops.push(lfa_graph.ids[cur]);
+        }
+    }
+
+    if (rerouting && backup) {
+        reroute_backups++;
+    }
+    return cost;
+}
+
+/**
+ * Called right after a change is applied, before the recompute.  If
+ * the change took down a link the tables still use, deliver the
+ * messages straight away over the old tables and their backups, and
+ * start timing the recompute this hides.
+ */
+void lfa_reroute() {
+    int failed = 0;
+    int n = lfa_graph.ids.size();
+    for (int u = 0; u < n; u++) {
+        for (int e = lfa_graph.offset[u]; e < lfa_graph.offset[u + 1]; e++) {
+            if (u < lfa_graph.adj[e] && live_cost(u, lfa_graph.adj[e]) < 0) {
+                failed++;
+            }
+        }
+    }
+    if (failed == 0) {
+        return;
+    }
+
+    rerouting = true;
+    reroute_failed = failed;
+    reroute_messages = stream_mode ? stream_count() : message_list.size();
+    reroute_backups = 0;
+    reroute_dropped = 0;
+    send_messages();
+    reroute_start = chrono::steady_clock::now();
+}
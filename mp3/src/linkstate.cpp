@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
@@ -6,32 +7,45 @@
 #include <map>
 #include <queue>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "routing.h"
+#include "graph.h"
+#include "linkstate.h"
+#include "stream.h"
 
 using namespace std;
 
-void read_topology();
-void read_messages();
-void send_messages();
-void update_tables();
-void Dijkstra(int source, vector<entry_t>& table);
-void print_table(vector<entry_t>& table);
-int apply_changes();
-int main(int argc, char** argv);
-
-// output file steam
-ofstream outfile;
+// output file steam, one per batch scenario
+thread_local ofstream outfile;
 // input file streams
-ifstream topofile, messagefile, changesfile;
+ifstream topofile, messagefile;
+thread_local ifstream changesfile;
 // map of node IDs to node structures storing topology info
-map<int, node_t*> topology;
+thread_local map<int, node_t*> topology;
+// unchanged topology shared by batch scenarios, NULL outside batch mode
+const map<int, node_t*>* base_topology = NULL;
 // list of messages to send between nodes
 vector<message_t*> message_list;
 // map of nodes to routing lists -- network wide routing info
-map<int, vector<entry_t>> routing_table;
+thread_local map<int, vector<entry_t>> routing_table;
+// all-pairs engine used by update_tables()
+engine_t engine = ENGINE_AUTO;
+// how send_messages() finds routes
+route_mode_t route_mode = ROUTE_TABLES;
+// keep run-length compressed tables instead of routing_table
+bool compact_mode = false;
+// precompute backup next hops and reroute around failed links
+bool lfa_mode = false;
+// compute the next epoch while printing the current one
+bool pipeline_mode = false;
+// reuse traced paths across messages and epochs
+bool cache_mode = false;
+// worker threads for the table engines, 0 for one per core; batch
+// scenarios already run one per thread and set their own to 1
+thread_local int engine_threads = 0;
 
 
 /**
@@ -89,77 +103,292 @@ void read_messages() {
     }
 }
 
+/**
+ * Follow the routing tables hop by hop from a source toward a
+ * destination, recording every node the message passes through.
+ *
+ * @param src  Source node ID
+ * @param dest Destination node ID
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, -1 if dest is unreachable, -2 if src has no table
+ */
+int trace_route(int src, int dest, queue<int>& hops) {
+    // get source node's forwarding table
+    vector<entry_t> forward_table = routing_table[src];
+
+    if (forward_table.size() == 0) {
+        return -2;
+    }
+
+    // find the entry for the destination
+    int index = 0;
+    while (forward_table[index].dest != dest && index < forward_table.size()) {
+        index++;
+    }
+
+    int cost = forward_table[index].path_cost;
+    if (cost < 0) {
+        return -1;
+    }
+
+    hops.push(src);
+    int next_hop = forward_table[index].next_hop;
+    if (next_hop != dest) {
+        hops.push(next_hop);
+    }
+    // follow the hops until we reach the destination
+    while (next_hop != dest) {
+        forward_table = routing_table[next_hop];
+        index = 0;
+        while (forward_table[index].dest != dest && index < forward_table.size()) {
+            index++;
+        }
+        next_hop = forward_table[index].next_hop;
+        if (next_hop != dest) {
+            hops.push(next_hop);
+        }
+    }
+    return cost;
+}
+
+/**
+ * Send one message, recording the path taken, and write
+ * the cost and path to the output file.
+ *
+ * @param msg Message to send
+ */
+static void send_message(const message_t& msg) {
+    int src = msg.src;
+    int dest = msg.dest;
+
+    outfile << "from " << src << " to " << dest;
+    cout << "Sending message from " << src
+         << " to " << dest
+         << ": " << msg.message << endl;
+
+    // trace the route through the tables, or directly on the
+    // topology in point-to-point mode
+    queue<int> hops;
+    int cost;
+    if (route_mode == ROUTE_TABLES && compact_mode) {
+        cost = compact_trace(src, dest, hops);
+    }
+    else if (route_mode == ROUTE_TABLES && lfa_mode) {
+        cost = lfa_trace(src, dest, hops);
+    }
+    else if (route_mode == ROUTE_TABLES && cache_mode) {
+        cost = cached_trace(src, dest, hops);
+    }
+    else if (route_mode == ROUTE_TABLES) {
+        cost = trace_route(src, dest, hops);
+    }
+    else {
+        cost = p2p_trace(src, dest, hops);
+    }
+
+    if (cost == -2) {
+        cout << ">> No routing table for node " << src << ". Skipping message.\n";
+        return;
+    }
+
+    // If destination is reachable, print the cost along with
+    // the path taken.  Otherwise print infinite cost and no path.
+    if (cost >= 0) {
+        outfile << " cost " << cost << " hops ";
+        cout << ">> Message delivered with cost " << cost << " via nodes ";
+
+        while (hops.size() > 0) {
+            outfile << hops.front() << ' ';
+            cout << hops.front() << ' ';
+            hops.pop();
+        }
+        outfile << "message " << msg.message << endl;
+        cout << endl;
+    }
+    // unreachable node
+    else {
+        outfile << " cost infinite hops unreachable message " << msg.message << endl;
+        cout << ">> Message could not be delivered\n";
+    }
+}
+
 /**
  * Send messages between nodes, recording the path taken,
  * and write the cost and path to the output file.
  */
 void send_messages() {
-    for (auto msg : message_list) {
-        int src = msg->src;
-        int dest = msg->dest;
+    if (cache_mode) {
+        cache_epoch();
+    }
+    if (stream_mode) {
+        stream_messages(send_message);
+    }
+    else {
+        for (auto msg : message_list) {
+            send_message(*msg);
+        }
+    }
+    outfile << endl;
+    cout << endl;
+    if (cache_mode) {
+        cache_report();
+    }
+}
 
-        outfile << "from " << src << " to " << dest;
-        cout << "Sending message from " << src
-             << " to " << dest
-             << ": " << msg->message << endl;
+/**
+ * Keep a freshly computed table for send_messages(), compressed
+ * in compact mode and as is otherwise.
+ *
+ * @param id    Node ID the table belongs to
+ * @param table Routing table with one entry per node, in ID order;
+ *              its contents are taken
+ */
+void save_table(int id, vector<entry_t>& table) {
+    if (compact_mode) {
+        compact_save(id, table);
+    }
+    else {
+        routing_table[id].swap(table);
+    }
+}
 
-        // get source node's forwarding table
-        vector<entry_t> forward_table = routing_table[src];
+/**
+ * Write a freshly computed table to the output file and keep it.
+ * Pipeline workers compute with no output file open and leave the
+ * printing to the main thread.
+ *
+ * @param id    Node ID the table belongs to
+ * @param table Routing table with one entry per node, in ID order
+ */
+void finish_table(int id, vector<entry_t>& table) {
+    if (outfile.is_open()) {
+        print_table(table);
+        outfile << endl;
+    }
+    save_table(id, table);
+}
 
-        if (forward_table.size() == 0) {
-            cout << ">> No routing table for node " << src << ". Skipping message.\n";
-            continue;
+/**
+ * Decide which all-pairs engine update_tables() should run.  Blocked
+ * Floyd-Warshall costs O(N^3) regardless of the link count, so it only
+ * pays off once the topology is dense enough; its N x N matrix also
+ * caps the node count it is used for.  Otherwise a bucket queue beats
+ * the original Dijkstra() whenever link costs are small, since it has
+ * to step through every path cost up to the farthest node.
+ *
+ * @return ENGINE_FLOYD, ENGINE_DIAL or ENGINE_DIJKSTRA
+ */
+engine_t choose_engine() {
+    if (engine != ENGINE_AUTO) {
+        return engine;
+    }
+
+    long n = topology.size();
+    long links = 0;
+    int max_cost = 0;
+    for (auto node : topology) {
+        links += node.second->neighbors.size();
+        for (auto neighbor : node.second->neighbors) {
+            max_cost = max(max_cost, neighbor.second);
         }
+    }
+    links /= 2;
 
-        // find the entry for the destination
-        int index = 0;
-        while (forward_table[index].dest != dest && index < forward_table.size()) {
-            index++;
+    if (n >= FLOYD_MIN_NODES && n <= FLOYD_MAX_NODES) {
+        double density = 2.0 * links / (n * (n - 1));
+        if (density >= FLOYD_MIN_DENSITY) {
+            return ENGINE_FLOYD;
         }
+    }
+    return max_cost <= DIAL_MAX_COST ? ENGINE_DIAL : ENGINE_DIJKSTRA;
+}
 
-        // If destination is reachable, trace the hops and print the
-        // cost along with the path taken.  Otherwise print infinite cost
-        // and no path.
-        int cost = forward_table[index].path_cost;
-        if (cost >= 0) {
-            outfile << " cost " << cost << " hops ";
-            cout << ">> Message delivered with cost " << cost << " via nodes ";
+/**
+ * Fill, print and save every routing table from one blocked
+ * Floyd-Warshall run.  Tables come out identical to Dijkstra()'s.
+ */
+void floyd_tables() {
+    graph_t graph;
+    build_graph(topology, graph);
 
-            queue<int> hops;
-            hops.push(src);
-            int next_hop = forward_table[index].next_hop;
-            if (next_hop != dest) {
-                hops.push(next_hop);
-            }
-            // follow the hops until we reach the destination
-            while (next_hop != dest) {
-                forward_table = routing_table[next_hop];
-                index = 0;
-                while (forward_table[index].dest != dest && index < forward_table.size()) {
-                    index++;
-                }
-                next_hop = forward_table[index].next_hop;
-                if (next_hop != dest) {
-                    hops.push(next_hop);
-                }
-            }
+    vector<int> dist;
+    int stride;
+    floyd_warshall(graph, dist, stride, worker_threads());
+
+    spt_t tree;
+    for (int s = 0; s < (int)graph.ids.size(); s++) {
+        vector<entry_t> forward_table;
+        tree_from_costs(graph, s, &dist[(size_t)s * stride], tree);
+        tree_to_table(graph, s, tree, forward_table);
+        finish_table(graph.ids[s], forward_table);
+    }
+}
+
+/**
+ * Number of worker threads the table engines should use.
+ */
+int worker_threads() {
+    return engine_threads > 0 ? engine_threads : max(1u, thread::hardware_concurrency());
+}
 
-            while (hops.size() > 0) {
-                outfile << hops.front() << ' ';
-                cout << hops.front() << ' ';
-                hops.pop();
+/**
+ * Fill, print and save every routing table from one shortest path
+ * tree per source, computed on a dense snapshot of the topology.
+ * Tables come out identical to Dijkstra()'s.  Per-source cost varies
+ * a lot (a hub in the giant component against a node in a small
+ * pocket), so the sources go to the work-stealing scheduler, each
+ * thread reusing one tree's worth of scratch across its sources.
+ * Compact mode takes the sources in waves of COMPACT_WAVE per thread
+ * and compresses each wave before starting the next, so only a wave
+ * of full tables is ever held.
+ */
+void tree_tables(engine_t kind) {
+    graph_t graph;
+    build_graph(topology, graph);
+    int max_cost = max_link_cost(graph);
+    int n = graph.ids.size();
+
+    vector<long> cost;
+    source_costs(graph, cost);
+    int threads = worker_threads();
+    int wave = compact_mode ? threads * COMPACT_WAVE : n;
+    vector<spt_t> trees(threads);
+    vector<vector<entry_t>> tables(min(wave, n));
+    sched_report_t report, part;
+    report.chunks = 0;
+    report.wall_ms = 0;
+    report.busy_ms.assign(threads, 0);
+    report.tasks.assign(threads, 0);
+    report.steals.assign(threads, 0);
+    for (int first = 0; first < n; first += wave) {
+        int last = min(n, first + wave);
+        vector<long> wave_cost(cost.begin() + first, cost.begin() + last);
+        steal_for(wave_cost, threads, [&](int i, int t) {
+            int s = first + i;
+            if (kind == ENGINE_DIAL) {
+                bucket_tree(graph, s, max_cost, trees[t]);
             }
-            outfile << "message " << msg->message << endl;
-            cout << endl;
+            else {
+                shortest_path_tree(graph, s, trees[t]);
+            }
+            tree_to_table(graph, s, trees[t], tables[i]);
+        }, part);
+        report.chunks += part.chunks;
+        report.wall_ms += part.wall_ms;
+        for (size_t t = 0; t < part.busy_ms.size(); t++) {
+            report.busy_ms[t] += part.busy_ms[t];
+            report.tasks[t] += part.tasks[t];
+            report.steals[t] += part.steals[t];
         }
-        // unreachable node
-        else {
-            outfile << " cost infinite hops unreachable message " << msg->message << endl;
-            cout << ">> Message could not be delivered\n";
+
+        // tables still come out in ID order
+        for (int s = first; s < last; s++) {
+            finish_table(graph.ids[s], tables[s - first]);
         }
     }
-    outfile << endl;
-    cout << endl;
+    if (threads > 1) {
+        sched_print("routing tables", report);
+    }
 }
 
 /**
@@ -167,18 +396,36 @@ void send_messages() {
  * to output file.
  */
 void update_tables() {
-    // loop through the topology data to get each
-    // node's forwarding table for updating
-    for (auto node : topology) {
-        // create a temp table for this node's forwarding info
-        vector<entry_t> forward_table;
-        // run Dijkstra's algorithm on this node
-        Dijkstra(node.first, forward_table);
-        // output the updated table to the outfile
-        print_table(forward_table);
-        outfile << endl;
-        // save this table in the global routing table
-        routing_table[node.first] = forward_table;
+    if (compact_mode) {
+        compact_begin();
+    }
+
+    // dense topologies are cheaper to solve all at once
+    engine_t kind = choose_engine();
+    if (kind == ENGINE_FLOYD) {
+        floyd_tables();
+    }
+    else if (kind == ENGINE_HEAP || kind == ENGINE_DIAL) {
+        tree_tables(kind);
+    }
+    else {
+        // loop through the topology data to get each
+        // node's forwarding table for updating
+        for (auto node : topology) {
+            // create a temp table for this node's forwarding info
+            vector<entry_t> forward_table;
+            // run Dijkstra's algorithm on this node
+            Dijkstra(node.first, forward_table);
+            // output the updated table and save it in the global routing table
+            finish_table(node.first, forward_table);
+        }
+    }
+
+    if (compact_mode) {
+        compact_report();
+    }
+    if (lfa_mode) {
+        lfa_tables();
     }
 }
 
@@ -357,6 +604,23 @@ void print_table(vector<entry_t>& table) {
     }
 }
 
+/**
+ * Give the running batch scenario its own copy of a node before a
+ * change touches it.  Until then the node is shared with the base
+ * topology and every other scenario.
+ *
+ * @param id Node ID about to change
+ */
+static void own_node(int id) {
+    if (base_topology == NULL) {
+        return;
+    }
+    auto base = base_topology->find(id);
+    if (base != base_topology->end() && topology[id] == base->second) {
+        topology[id] = new node_t(*base->second);
+    }
+}
+
 /**
  * Modify the network topology according to a change from
  * the changefile.  Creates, updates, or destroys a link
@@ -371,22 +635,32 @@ void print_table(vector<entry_t>& table) {
  */
 int apply_changes() {
     int src, dest, cost;
-    if (changesfile.is_open() && !changesfile.eof()) {
-        changesfile >> src >> dest >> cost;
+    // stop at the first line that does not read, so a trailing
+    // newline no longer turns into a bogus extra change
+    if (changesfile.is_open() && changesfile >> src >> dest >> cost) {
+        own_node(src);
+        own_node(dest);
         // update an existing link or add a new one
         // if it doesn't already exist
         if (cost > 0) {
-            printf("Setting link %d <-> %d to %d\n", src, dest, cost);
+            // through cout, which --batch mutes while scenarios interleave
+            cout << "Setting link " << src << " <-> " << dest << " to " << cost << endl;
             topology[src]->neighbors[dest] = cost;
             topology[dest]->neighbors[src] = cost;
+            if (cache_mode) {
+                cache_link_changed(src, dest);
+            }
             // return successful change
             return 1;
         }
         // remove a link or do nothing if no link exists
         else if (cost == -999) {
-            printf("Removing link %d <-> %d\n", src, dest);
+            cout << "Removing link " << src << " <-> " << dest << endl;
             topology[src]->neighbors.erase(dest);
             topology[dest]->neighbors.erase(src);
+            if (cache_mode) {
+                cache_link_changed(src, dest);
+            }
             // return successful change
             return 1;
         }
@@ -396,34 +670,189 @@ int apply_changes() {
     return 0;
 }
 
+/**
+ * Update the routing tables and send messages as long as there
+ * are changes to be made.  Point-to-point mode routes the messages
+ * only and prints no tables.
+ *
+ * @return Number of epochs run, one more than the changes applied
+ */
+int run_epochs() {
+    if (pipeline_mode) {
+        return run_pipelined();
+    }
+
+    int epochs = 0;
+    while (1) {
+        epochs++;
+        if (route_mode == ROUTE_TABLES) {
+            update_tables();
+        }
+        else {
+            p2p_prepare();
+        }
+        send_messages();
+
+        if (0 == apply_changes()) {
+            break;
+        }
+        // with backups, messages get through a failed link
+        // before the tables are recomputed
+        if (lfa_mode) {
+            lfa_reroute();
+        }
+    }
+    return epochs;
+}
+
 int main(int argc, char** argv) {
     //printf("Number of arguments: %d", argc);
-    if (argc != 4) {
-        printf("Usage: ./linkstate topofile messagefile changesfile\n");
+    // pull out the optional mode flags, leaving the file names
+    bool daemon_mode = false;
+    bool whatif_mode = false;
+    bool batch_mode = false;
+    const char* daemon_socket = NULL;
+    vector<char*> files;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--daemon") {
+            daemon_mode = true;
+        }
+        else if (arg.compare(0, 9, "--daemon=") == 0) {
+            daemon_mode = true;
+            daemon_socket = argv[i] + 9;
+        }
+        else if (arg == "--whatif") {
+            whatif_mode = true;
+        }
+        else if (arg == "--batch") {
+            batch_mode = true;
+        }
+        else if (arg == "--engine=dijkstra") {
+            engine = ENGINE_DIJKSTRA;
+        }
+        else if (arg == "--engine=heap") {
+            engine = ENGINE_HEAP;
+        }
+        else if (arg == "--engine=dial") {
+            engine = ENGINE_DIAL;
+        }
+        else if (arg == "--engine=floyd") {
+            engine = ENGINE_FLOYD;
+        }
+        else if (arg == "--engine=auto") {
+            engine = ENGINE_AUTO;
+        }
+        else if (arg == "--compact") {
+            compact_mode = true;
+        }
+        else if (arg == "--lfa") {
+            lfa_mode = true;
+        }
+        else if (arg == "--pipeline") {
+            pipeline_mode = true;
+        }
+        else if (arg == "--stream") {
+            stream_mode = true;
+        }
+        else if (arg == "--cache") {
+            cache_mode = true;
+        }
+        else if (arg == "--p2p") {
+            route_mode = ROUTE_BIDIR;
+        }
+        else if (arg == "--p2p=alt") {
+            route_mode = ROUTE_ALT;
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0) {
+            engine_threads = atoi(argv[i] + 10);
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    size_t wanted = daemon_mode || whatif_mode ? 1 : 3;
+    bool count_ok = batch_mode ? files.size() >= wanted : files.size() == wanted;
+    // backups and pipelined epochs both need the uncompressed tables,
+    // and the path cache checks its paths against them
+    int table_modes = (route_mode != ROUTE_TABLES) + compact_mode + lfa_mode + pipeline_mode;
+    bool conflict = (lfa_mode || pipeline_mode) && table_modes > 1;
+    conflict = conflict || (cache_mode && table_modes - pipeline_mode > 0);
+    if (!count_ok || conflict) {
+        printf("Usage: ./linkstate [--engine=auto|dijkstra|heap|dial|floyd] [--threads=N] [--stream] [--cache] [--p2p[=alt] | --compact | --lfa | --pipeline] topofile messagefile changesfile\n");
+        printf("       ./linkstate --daemon[=socketpath] topofile\n");
+        printf("       ./linkstate --whatif topofile\n");
+        printf("       ./linkstate --batch [options] topofile messagefile changesfile...\n");
         return -1;
     }
 
-    // open the files
+    // daemon mode loads the topology once and then serves queries
+    if (daemon_mode) {
+        topofile.open(files[0]);
+        read_topology();
+        topofile.close();
+        return run_daemon(daemon_socket);
+    }
+
+    // what-if mode reports the impact of every link failure instead
+    if (whatif_mode) {
+        outfile.open("output.txt");
+        topofile.open(files[0]);
+        read_topology();
+        whatif_report();
+        outfile.close();
+        topofile.close();
+        return 0;
+    }
+
+    // batch mode runs every changes file against one parsed topology
+    if (batch_mode) {
+        topofile.open(files[0]);
+        read_topology();
+        topofile.close();
+        if (stream_mode) {
+            stream_open(files[1]);
+        }
+        else {
+            messagefile.open(files[1]);
+            read_messages();
+            messagefile.close();
+        }
+
+        vector<char*> changes(files.begin() + 2, files.end());
+        int status = run_batch(changes);
+        for (auto msg : message_list) {
+            delete msg;
+        }
+        stream_close();
+        return status;
+    }
+
+    // open the files; streamed messages are mapped, not read
     outfile.open("output.txt");
-    topofile.open(argv[1]);
-    messagefile.open(argv[2]);
-    changesfile.open(argv[3]);
+    topofile.open(files[0]);
+    changesfile.open(files[2]);
 
     // read initial state data
     read_topology();
-    read_messages();
+    if (stream_mode) {
+        stream_open(files[1]);
+    }
+    else {
+        messagefile.open(files[1]);
+        read_messages();
+    }
 
     // Update the routing tables and send messages
     // as long as there are changes to be made
-    do {
-        update_tables();
-        send_messages();
-    } while (0 != apply_changes());
+    run_epochs();
 
     // cleanup allocated memory
     for (auto msg : message_list) {
         delete msg;
     }
+    stream_close();
 
     // close the files
     outfile.close();
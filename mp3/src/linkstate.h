@@ -0,0 +1,108 @@
+#ifndef _LINKSTATE_H
+#define _LINKSTATE_H
+
+#include <fstream>
+#include <map>
+#include <queue>
+#include <vector>
+
+#include "routing.h"
+
+using namespace std;
+
+// auto engine choice: Floyd-Warshall only for dense, mid-sized topologies
+#define FLOYD_MIN_NODES     64
+#define FLOYD_MAX_NODES     8192
+#define FLOYD_MIN_DENSITY   0.01
+// auto engine choice: Dial's bucket queue when no link costs more than this
+#define DIAL_MAX_COST       64
+
+/**
+ * All-pairs engine used by update_tables()
+ */
+typedef enum {
+    ENGINE_AUTO,        // pick by topology density
+    ENGINE_DIJKSTRA,    // Dijkstra() from every source
+    ENGINE_HEAP,        // binary heap Dijkstra on the dense graph
+    ENGINE_DIAL,        // bucket queue Dijkstra on the dense graph
+    ENGINE_FLOYD        // one blocked Floyd-Warshall run
+} engine_t;
+
+// landmarks used by --p2p=alt
+#define P2P_LANDMARKS       8
+// --compact: sources per thread whose full tables are held at once
+#define COMPACT_WAVE        64
+
+/**
+ * Route source used by send_messages()
+ */
+typedef enum {
+    ROUTE_TABLES,       // trace through the tables from update_tables()
+    ROUTE_BIDIR,        // point-to-point bidirectional search, no tables
+    ROUTE_ALT           // as ROUTE_BIDIR, with ALT landmark potentials
+} route_mode_t;
+
+void read_topology();
+void read_messages();
+int trace_route(int src, int dest, queue<int>& hops);
+int cached_trace(int src, int dest, queue<int>& hops);
+void cache_epoch();
+void cache_link_changed(int a, int b);
+void cache_report();
+void cache_clear();
+void save_table(int id, vector<entry_t>& table);
+void finish_table(int id, vector<entry_t>& table);
+void send_messages();
+void update_tables();
+engine_t choose_engine();
+void floyd_tables();
+int worker_threads();
+void tree_tables(engine_t kind);
+void Dijkstra(int source, vector<entry_t>& table);
+void print_table(vector<entry_t>& table);
+int apply_changes();
+int run_epochs();
+int run_pipelined();
+int run_batch(vector<char*>& changes);
+int run_daemon(const char* socket_path);
+void p2p_prepare();
+int p2p_trace(int src, int dest, queue<int>& hops);
+void compact_begin();
+void compact_save(int id, vector<entry_t>& table);
+void compact_report();
+int compact_trace(int src, int dest, queue<int>& hops);
+void whatif_report();
+void lfa_tables();
+int lfa_trace(int src, int dest, queue<int>& hops);
+void lfa_reroute();
+int main(int argc, char** argv);
+
+// output file steam
+extern thread_local ofstream outfile;
+// input file streams
+extern ifstream topofile, messagefile;
+extern thread_local ifstream changesfile;
+// map of node IDs to node structures storing topology info
+extern thread_local map<int, node_t*> topology;
+// unchanged topology shared by batch scenarios, NULL outside batch mode
+extern const map<int, node_t*>* base_topology;
+// list of messages to send between nodes
+extern vector<message_t*> message_list;
+// map of nodes to routing lists -- network wide routing info
+extern thread_local map<int, vector<entry_t>> routing_table;
+// all-pairs engine used by update_tables()
+extern engine_t engine;
+// how send_messages() finds routes
+extern route_mode_t route_mode;
+// keep run-length compressed tables instead of routing_table
+extern bool compact_mode;
+// precompute backup next hops and reroute around failed links
+extern bool lfa_mode;
+// compute the next epoch while printing the current one
+extern bool pipeline_mode;
+// reuse traced paths across messages and epochs
+extern bool cache_mode;
+// worker threads for the table engines, 0 for one per core
+extern thread_local int engine_threads;
+
+#endif /* _LINKSTATE_H */
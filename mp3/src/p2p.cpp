@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "linkstate.h"
+
+using namespace std;
+
+typedef pair<long long, int> item_t;
+typedef priority_queue<item_t, vector<item_t>, greater<item_t>> heap_t;
+
+/**
+ * Pick landmarks by farthest-point selection and record the exact
+ * path cost from each of them to every node.  The first landmark is
+ * the lowest ID node; each next one is the node farthest from all
+ * landmarks chosen so far, and unreachable nodes count as farthest,
+ * so every component ends up with a landmark of its own.
+ *
+ * @param graph Graph to search
+ * @param count Number of landmarks wanted
+ * @param lm    Landmark costs to fill
+ */
+void select_landmarks(const graph_t& graph, int count, landmarks_t& lm) {
+    int n = graph.ids.size();
+    lm.dist.clear();
+    if (n == 0) {
+        return;
+    }
+
+    vector<long long> nearest(n, LLONG_MAX);
+    int next = 0;
+    spt_t tree;
+    for (int l = 0; l < count && l < n; l++) {
+        shortest_path_tree(graph, next, tree);
+        lm.dist.push_back(tree.dist);
+
+        for (int v = 0; v < n; v++) {
+            long long d = tree.dist[v] < 0 ? LLONG_MAX - 1 : tree.dist[v];
+            nearest[v] = min(nearest[v], d);
+        }
+        next = max_element(nearest.begin(), nearest.end()) - nearest.begin();
+        if (nearest[next] == 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * ALT lower bound on the path cost between two nodes:
+ * max over landmarks L of |d(L, a) - d(L, b)|.
+ */
+static int landmark_bound(const landmarks_t& lm, int a, int b) {
+    int bound = 0;
+    for (auto& d : lm.dist) {
+        if (d[a] >= 0 && d[b] >= 0) {
+            bound = max(bound, abs(d[a] - d[b]));
+        }
+    }
+    return bound;
+}
+
+/**
+ * Prepare a point-to-point query engine for a graph.
+ *
+ * @param q         Engine to set up
+ * @param graph     Graph to answer queries on; must outlive q
+ * @param landmarks Number of ALT landmarks, 0 for plain bidirectional search
+ */
+void p2p_init(p2p_t& q, const graph_t& graph, int landmarks) {
+    int n = graph.ids.size();
+    q.graph = &graph;
+    q.gen = 0;
+    q.seen_f.assign(n, 0);
+    q.seen_b.assign(n, 0);
+    q.done_f.assign(n, 0);
+    q.done_b.assign(n, 0);
+    q.seen_r.assign(n, 0);
+    q.dist_f.assign(n, 0);
+    q.dist_b.assign(n, 0);
+    q.dist_r.assign(n, 0);
+    q.region.clear();
+    select_landmarks(graph, landmarks, q.landmarks);
+}
+
+/**
+ * Bidirectional search between src and dest on ALT-reduced costs,
+ * with the average potential p(u) = (pi_dest(u) - pi_src(u)) / 2 so
+ * both directions stay consistent.  Keys are doubled to stay integer.
+ * The search stops only once the two heap tops sum to more than the
+ * best path, so every node on any shortest path has been settled by
+ * at least one side; those settled nodes are left in q.region.
+ *
+ * @return Path cost from src to dest, or -1 if unreachable
+ */
+static int bidirectional_search(p2p_t& q, int src, int dest) {
+    const graph_t& g = *q.graph;
+    unsigned gen = q.gen;
+    bool alt = !q.landmarks.dist.empty();
+    auto potential = [&](int u) -> long long {
+        return alt ? landmark_bound(q.landmarks, u, dest) - landmark_bound(q.landmarks, src, u) : 0;
+    };
+
+    heap_t heap_f, heap_b;
+    q.seen_f[src] = gen;
+    q.dist_f[src] = 0;
+    heap_f.push(item_t(potential(src), src));
+    q.seen_b[dest] = gen;
+    q.dist_b[dest] = 0;
+    heap_b.push(item_t(-potential(dest), dest));
+
+    long long best = LLONG_MAX;
+    if (src == dest) {
+        best = 0;
+    }
+
+    while (!heap_f.empty() && !heap_b.empty()) {
+        if (best != LLONG_MAX && heap_f.top().first + heap_b.top().first > 2 * best) {
+            break;
+        }
+
+        // advance whichever side has the smaller key
+        bool forward = heap_f.top().first <= heap_b.top().first;
+        heap_t& heap = forward ? heap_f : heap_b;
+        vector<unsigned>& seen = forward ? q.seen_f : q.seen_b;
+        vector<unsigned>& done = forward ? q.done_f : q.done_b;
+        vector<int>& dist = forward ? q.dist_f : q.dist_b;
+        vector<unsigned>& other_seen = forward ? q.seen_b : q.seen_f;
+        vector<int>& other_dist = forward ? q.dist_b : q.dist_f;
+
+        int u = heap.top().second;
+        heap.pop();
+        if (done[u] == gen) {
+            continue;
+        }
+        done[u] = gen;
+        if (q.done_f[u] != gen || q.done_b[u] != gen) {
+            q.region.push_back(u);
+        }
+
+        for (int e = g.offset[u]; e < g.offset[u + 1]; e++) {
+            int v = g.adj[e];
+            int w = dist[u] + g.cost[e];
+            if (seen[v] != gen || w < dist[v]) {
+                seen[v] = gen;
+                dist[v] = w;
+                long long p = potential(v);
+                heap.push(item_t(2LL * w + (forward ? p : -p), v));
+            }
+            if (other_seen[v] == gen) {
+                best = min(best, (long long)w + other_dist[v]);
+            }
+        }
+    }
+
+    return best == LLONG_MAX ? -1 : (int)best;
+}
+
+/**
+ * Dijkstra from a node restricted to q.region, stopping once dest is
+ * settled.  Every shortest path from a node on a src -> dest shortest
+ * path stays inside the region, so costs of those nodes are exact and
+ * everything else is an upper bound, which never passes the exact
+ * predecessor test used by p2p_route().
+ */
+static void region_search(p2p_t& q, int from, int dest) {
+    const graph_t& g = *q.graph;
+    unsigned gen = ++q.gen;
+    for (int u : q.region) {
+        q.done_f[u] = gen;    // reuse done_f to mark region membership
+    }
+
+    heap_t heap;
+    q.seen_r[from] = gen;
+    q.dist_r[from] = 0;
+    heap.push(item_t(0, from));
+    while (!heap.empty()) {
+        int d = heap.top().first;
+        int u = heap.top().second;
+        heap.pop();
+        if (d > q.dist_r[u]) {
+            continue;
+        }
+        if (u == dest) {
+            break;
+        }
+        for (int e = g.offset[u]; e < g.offset[u + 1]; e++) {
+            int v = g.adj[e];
+            int w = d + g.cost[e];
+            if (q.done_f[v] == gen && (q.seen_r[v] != gen || w < q.dist_r[v])) {
+                q.seen_r[v] = gen;
+                q.dist_r[v] = w;
+                heap.push(item_t(w, v));
+            }
+        }
+    }
+}
+
+/**
+ * Route one message without building any full tree.  The path is
+ * the one send_messages() traces through the routing tables: each
+ * hop forwards along its own shortest path tree, where a node's
+ * parent is its lowest ID predecessor.  After one bidirectional
+ * search bounds the shortest path region, every hop reconstructs
+ * its own tree's path to dest from a small search inside it.
+ *
+ * @param q    Engine set up by p2p_init()
+ * @param src  Dense index of the source
+ * @param dest Dense index of the destination
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, or -1 if dest is unreachable
+ */
+int p2p_route(p2p_t& q, int src, int dest, vector<int>& hops) {
+    const graph_t& g = *q.graph;
+    hops.clear();
+    q.region.clear();
+    q.gen++;
+
+    int cost = bidirectional_search(q, src, dest);
+    if (cost < 0) {
+        return -1;
+    }
+    hops.push_back(src);
+
+    int cur = src;
+    while (cur != dest) {
+        region_search(q, cur, dest);
+        unsigned gen = q.gen;
+
+        // walk cur's tree back from dest until the hop after cur
+        int v = dest;
+        while (1) {
+            int parent = -1;
+            for (int e = g.offset[v]; e < g.offset[v + 1]; e++) {
+                int u = g.adj[e];
+                if (q.seen_r[u] == gen && q.dist_r[u] + g.cost[e] == q.dist_r[v]) {
+                    parent = u;
+                    break;
+                }
+            }
+            if (parent == cur || parent < 0) {
+                break;
+            }
+            v = parent;
+        }
+
+        cur = v;
+        if (cur != dest) {
+            hops.push_back(cur);
+        }
+    }
+    return cost;
+}
+
+// graph and query engine for the current topology in point-to-point mode,
+// kept per thread so batch scenarios do not share them
+static thread_local graph_t p2p_graph;
+static thread_local p2p_t p2p_engine;
+
+/**
+ * Rebuild the point-to-point engine after the topology changed.
+ * Landmarks are only chosen (and their trees computed) in ALT mode.
+ */
+void p2p_prepare() {
+    build_graph(topology, p2p_graph);
+    p2p_init(p2p_engine, p2p_graph, route_mode == ROUTE_ALT ? P2P_LANDMARKS : 0);
+}
+
+/**
+ * Trace a message's route with the point-to-point engine, giving the
+ * same cost and hops trace_route() reads from the routing tables.
+ *
+ * @param src  Source node ID
+ * @param dest Destination node ID
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, -1 if dest is unreachable, -2 if src is unknown
+ */
+int p2p_trace(int src, int dest, queue<int>& hops) {
+    auto s = p2p_graph.index.find(src);
+    auto d = p2p_graph.index.find(dest);
+    if (s == p2p_graph.index.end()) {
+        return -2;
+    }
+    if (d == p2p_graph.index.end()) {
+        return -1;
+    }
+
+    vector<int> path;
+    int cost = p2p_route(p2p_engine, s->second, d->second, path);
+    for (int hop : path) {
+        hops.push(p2p_graph.ids[hop]);
+    }
+    return cost;
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "linkstate.h"
+
+using namespace std;
+
+/**
+ * Cached Path Struct
+ *   The route one (src, dest) pair took the last time it was traced.
+ *   Its hops live in the cache arena rather than in a vector of
+ *   their own.
+ */
+typedef struct cached_path {
+    int     start;      // first hop in the arena
+    int     length;     // hops, src included and dest excluded
+    int     cost;       // path cost, -1 if unreachable
+    int     checked;    // epoch the path was last found to match the tables
+} cached_path_t;
+
+/**
+ * Path Cache Statistics Struct
+ *   What became of the lookups of one epoch.
+ */
+typedef struct cache_stats {
+    long    lookups;    // messages routed through the cache
+    long    hits;       // paths already checked this epoch
+    long    kept;       // paths from an earlier epoch the tables still agree with
+    long    traced;     // paths traced afresh
+    long    dropped;    // paths dropped because a change hit one of their links
+} cache_stats_t;
+
+// cached paths by (src, dest); per thread for --batch
+static thread_local unordered_map<long long, cached_path_t> cache;
+// hops of every cached path, back to back
+static thread_local vector<int> arena;
+// arena ints no cached path uses any more
+static thread_local size_t garbage = 0;
+// bumped once per send_messages(), when the tables may have changed
+static thread_local int epoch = 0;
+static thread_local cache_stats_t stats;
+
+/**
+ * Cache key of a (src, dest) pair.
+ */
+static long long cache_key(int src, int dest) {
+    return (long long)src << 32 | (unsigned int)dest;
+}
+
+/**
+ * Find the table entry of a node for a destination.  Tables hold one
+ * entry per node in ID order, so this is a binary search.
+ *
+ * @return The entry, NULL if there is none
+ */
+static const entry_t* find_entry(int node, int dest) {
+    auto table = routing_table.find(node);
+    if (table == routing_table.end()) {
+        return NULL;
+    }
+    auto it = lower_bound(table->second.begin(), table->second.end(), dest,
+                          [](const entry_t& entry, int id) { return entry.dest < id; });
+    return it != table->second.end() && it->dest == dest ? &*it : NULL;
+}
+
+/**
+ * Whether a cached path is still the one trace_route() would take:
+ * the source's entry has the same cost and every hop still forwards
+ * to the next one.  These are the only table entries the trace reads.
+ */
+static bool still_valid(const cached_path_t& path, int src, int dest) {
+    const entry_t* entry = find_entry(src, dest);
+    if (entry == NULL || entry->path_cost != path.cost) {
+        return false;
+    }
+    const int* hops = arena.data() + path.start;
+    for (int i = 0; i < path.length; i++) {
+        int next = i + 1 < path.length ? hops[i + 1] : dest;
+        entry = i == 0 ? entry : find_entry(hops[i], dest);
+        if (entry == NULL || entry->next_hop != next) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Copy the live paths into a fresh arena once most of it is garbage.
+ */
+static void collect_arena() {
+    if (garbage * 2 <= arena.size()) {
+        return;
+    }
+    vector<int> live;
+    live.reserve(arena.size() - garbage);
+    for (auto& p : cache) {
+        int start = live.size();
+        live.insert(live.end(), arena.begin() + p.second.start,
+                    arena.begin() + p.second.start + p.second.length);
+        p.second.start = start;
+    }
+    arena.swap(live);
+    garbage = 0;
+}
+
+/**
+ * Start a new epoch: every cached path has to be checked against the
+ * new tables once before it is used again.
+ */
+void cache_epoch() {
+    epoch++;
+}
+
+/**
+ * Route a message through the path cache.  A path traced or checked
+ * earlier in this epoch is used as is; one from an earlier epoch is
+ * checked against the current tables first and traced again only if
+ * they changed under it.
+ *
+ * @param src  Source node ID
+ * @param dest Destination node ID
+ * @param hops Filled with src and the intermediate hops, excluding dest
+ * @return     Path cost, -1 if dest is unreachable, -2 if src has no table
+ */
+int cached_trace(int src, int dest, queue<int>& hops) {
+    // pairs trace_route() cannot look up go straight through
+    if (find_entry(src, dest) == NULL) {
+        return trace_route(src, dest, hops);
+    }
+
+    stats.lookups++;
+    long long key = cache_key(src, dest);
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second.checked == epoch) {
+        stats.hits++;
+    }
+    else if (it != cache.end() && still_valid(it->second, src, dest)) {
+        it->second.checked = epoch;
+        stats.kept++;
+    }
+    else {
+        queue<int> traced;
+        cached_path_t path;
+        path.cost = trace_route(src, dest, traced);
+        path.start = arena.size();
+        path.length = traced.size();
+        path.checked = epoch;
+        for (; !traced.empty(); traced.pop()) {
+            arena.push_back(traced.front());
+        }
+        if (it != cache.end()) {
+            garbage += it->second.length;
+            it->second = path;
+        }
+        else {
+            it = cache.insert(make_pair(key, path)).first;
+        }
+        stats.traced++;
+    }
+
+    const cached_path_t& path = it->second;
+    for (int i = 0; i < path.length; i++) {
+        hops.push(arena[path.start + i]);
+    }
+    return path.cost;
+}
+
+/**
+ * Drop the cached paths that cross a link a change just touched;
+ * whatever happened to the link, their cost or route is different
+ * now.  Other paths stay and are checked on their next use.
+ *
+ * @param a One end of the changed link
+ * @param b The other end
+ */
+void cache_link_changed(int a, int b) {
+    for (auto it = cache.begin(); it != cache.end(); ) {
+        const cached_path_t& path = it->second;
+        const int* hops = arena.data() + path.start;
+        int dest = (int)(it->first & 0xffffffff);
+        bool crosses = false;
+        for (int i = 0; i < path.length && !crosses; i++) {
+            int next = i + 1 < path.length ? hops[i + 1] : dest;
+            crosses = (hops[i] == a && next == b) || (hops[i] == b && next == a);
+        }
+        if (crosses) {
+            garbage += path.length;
+            it = cache.erase(it);
+            stats.dropped++;
+        }
+        else {
+            ++it;
+        }
+    }
+    collect_arena();
+}
+
+/**
+ * Print how the cache did this epoch, counting the paths dropped by
+ * the change that led up to it, and start counting afresh.
+ */
+void cache_report() {
+    collect_arena();
+    cout << "Path cache: " << stats.lookups << " lookups, " << stats.hits << " hits, "
+         << stats.kept << " kept from earlier epochs, " << stats.traced << " traced, "
+         << stats.dropped << " dropped by changes, " << cache.size() << " paths in "
+         << arena.size() * sizeof(int) << " arena bytes" << endl;
+    stats = cache_stats_t();
+}
+
+/**
+ * Forget every cached path, for a batch scenario that is done.
+ */
+void cache_clear() {
+    cache.clear();
+    vector<int>().swap(arena);
+    garbage = 0;
+    stats = cache_stats_t();
+}
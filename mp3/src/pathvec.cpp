@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "distvec.h"
+
+using namespace std;
+
+/**
+ * Path Cell Struct
+ *   One hop of an AS path.  A node's path to a destination is the
+ *   node itself followed by the path its next hop advertised, so every
+ *   path is a cell pointing at a path that already exists and all the
+ *   routes through a neighbor share that neighbor's cells.
+ */
+typedef struct path_cell {
+    int     head;   // dense index of the first node on the path
+    int     tail;   // cell holding the rest of the path, -1 at the destination
+} path_cell_t;
+
+// path vector "infinity" for unreachable destinations
+#define PV_UNREACHABLE (INT_MAX / 2)
+
+// every path of the current epoch; cells are never changed once
+// advertised, only collected once the protocol has converged
+static vector<path_cell_t> cells;
+
+// each node's routes by dense index: [node][dest]
+static vector<vector<int>> pv_dist, pv_hop, pv_path;
+// links the state was last converged on, to greet new neighbors
+static vector<vector<pair<int, int>>> pv_links;
+
+/**
+ * Make a path cell.
+ */
+static int new_path(int head, int tail) {
+    path_cell_t cell;
+    cell.head = head;
+    cell.tail = tail;
+    cells.push_back(cell);
+    return cells.size() - 1;
+}
+
+/**
+ * Loop detection: look for a node on an advertised path.
+ */
+static bool on_path(int path, int node) {
+    for (; path >= 0; path = cells[path].tail) {
+        if (cells[path].head == node) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Route Update Struct
+ *   One route a node changed this round, held back until everyone
+ *   advertises at the end of the round.
+ */
+typedef struct route_update {
+    int     node;   // dense index of the node whose route changed
+    int     dest;   // dense index of the destination
+    int     dist;   // new path cost
+    int     hop;    // new next hop, -1 if unreachable
+    int     path;   // new path cell, -1 if unreachable
+} route_update_t;
+
+/**
+ * Recompute some of node y's routes from the paths its neighbors
+ * advertised last round.  Paths that already contain y are dropped,
+ * which is what keeps path vector free of loops and counting to
+ * infinity.  Neighbors are tried in ID order and only a strictly
+ * cheaper path wins, so ties go to the lowest next hop ID as in
+ * distance vector.
+ *
+ * @param y       Dense index of the node
+ * @param dests   Destinations to recompute
+ * @param updates Routes that changed are appended here
+ */
+static void pv_update(int y, const vector<int>& dests, vector<route_update_t>& updates) {
+    int degree = links[y].size();
+    vector<bool> looped(degree);
+    for (int d : dests) {
+        if (d == y) {
+            continue;
+        }
+        // take the cheapest path, then make sure it does not loop; a
+        // path y already uses was checked when its cell was made
+        int best, via, path = pv_path[y][d];
+        fill(looped.begin(), looped.end(), false);
+        while (1) {
+            int pick = -1;
+            best = PV_UNREACHABLE;
+            for (int i = 0; i < degree; i++) {
+                int x = links[y][i].first;
+                int cost = links[y][i].second + pv_dist[x][d];
+                if (!looped[i] && pv_path[x][d] >= 0 && cost < best) {
+                    best = cost;
+                    pick = i;
+                }
+            }
+            via = pick < 0 ? -1 : links[y][pick].first;
+            if (via < 0 || (path >= 0 && cells[path].tail == pv_path[via][d])
+                || !on_path(pv_path[via][d], y)) {
+                break;
+            }
+            looped[pick] = true;
+        }
+
+        // keep the old cell if it still says the same thing
+        if (via < 0) {
+            path = -1;
+        }
+        else if (path < 0 || cells[path].tail != pv_path[via][d]) {
+            path = new_path(y, pv_path[via][d]);
+        }
+        if (path != pv_path[y][d] || best != pv_dist[y][d]) {
+            route_update_t update;
+            update.node = y;
+            update.dest = d;
+            update.dist = best;
+            update.hop = via;
+            update.path = path;
+            updates.push_back(update);
+        }
+    }
+}
+
+/**
+ * Drop the cells no route uses any more and renumber the rest,
+ * keeping the cell store as small as the converged tables.
+ */
+static void collect_paths() {
+    vector<int> moved(cells.size(), -1);
+    vector<path_cell_t> live;
+    vector<int> chain;
+    for (auto& row : pv_path) {
+        for (int path : row) {
+            // copy the cells of this path not already copied, from
+            // the destination end so each tail is renumbered first
+            for (; path >= 0 && moved[path] < 0; path = cells[path].tail) {
+                chain.push_back(path);
+            }
+            for (; !chain.empty(); chain.pop_back()) {
+                path_cell_t cell = cells[chain.back()];
+                cell.tail = cell.tail < 0 ? -1 : moved[cell.tail];
+                moved[chain.back()] = live.size();
+                live.push_back(cell);
+            }
+        }
+    }
+    for (auto& row : pv_path) {
+        for (int& path : row) {
+            path = path < 0 ? -1 : moved[path];
+        }
+    }
+    live.shrink_to_fit();
+    cells.swap(live);
+}
+
+/**
+ * Run synchronous path vector rounds until no route changes.  Like a
+ * BGP update, each message carries only the routes that changed, and
+ * a node only recomputes the destinations it heard about.  Rather than
+ * keeping a copy of every neighbor's routes, a round reads them as
+ * they stood at the end of the previous round, which is the same
+ * thing.  State carries over between epochs like distance vector's.
+ *
+ * @param stats Filled with the rounds and messages it took
+ */
+void pv_converge(convergence_t& stats) {
+    stats.rounds = 0;
+    stats.messages = 0;
+    int n = nodes.size();
+
+    // start over whenever the node numbering changed
+    if ((int)pv_dist.size() != n) {
+        cells.clear();
+        pv_dist.assign(n, vector<int>(n, PV_UNREACHABLE));
+        pv_hop.assign(n, vector<int>(n, -1));
+        pv_path.assign(n, vector<int>(n, -1));
+        pv_links.assign(n, vector<pair<int, int>>());
+        for (int y = 0; y < n; y++) {
+            pv_dist[y][y] = 0;
+            pv_hop[y][y] = y;
+            pv_path[y][y] = new_path(y, -1);
+        }
+    }
+
+    // nodes whose links changed look at every destination again,
+    // and a new neighbor is sent the full table
+    vector<int> all(n);
+    for (int d = 0; d < n; d++) {
+        all[d] = d;
+    }
+    vector<vector<int>> pending(n);
+    for (int y = 0; y < n; y++) {
+        if (links[y] == pv_links[y]) {
+            continue;
+        }
+        pending[y] = all;
+        for (auto link : links[y]) {
+            auto it = lower_bound(pv_links[y].begin(), pv_links[y].end(), make_pair(link.first, INT_MIN));
+            if (it == pv_links[y].end() || it->first != link.first) {
+                stats.messages++;
+            }
+        }
+    }
+    pv_links = links;
+
+    vector<route_update_t> updates;
+    while (1) {
+        updates.clear();
+        for (int y = 0; y < n; y++) {
+            if (pending[y].empty()) {
+                continue;
+            }
+            sort(pending[y].begin(), pending[y].end());
+            pending[y].erase(unique(pending[y].begin(), pending[y].end()), pending[y].end());
+            pv_update(y, pending[y], updates);
+            pending[y].clear();
+        }
+        if (updates.empty()) {
+            break;
+        }
+
+        // everyone advertises at once at the end of the round, one
+        // message to each neighbor from every node with news
+        stats.rounds++;
+        int last = -1;
+        for (auto& update : updates) {
+            int x = update.node;
+            pv_dist[x][update.dest] = update.dist;
+            pv_hop[x][update.dest] = update.hop;
+            pv_path[x][update.dest] = update.path;
+            if (x != last) {
+                stats.messages += links[x].size();
+                last = x;
+            }
+            for (auto link : links[x]) {
+                pending[link.first].push_back(update.dest);
+            }
+        }
+    }
+    collect_paths();
+}
+
+/**
+ * Read one node's converged path vector table.
+ *
+ * @param source Node ID of the table owner
+ * @param table  Routing table to be filled for source node
+ */
+void PathVec(int source, vector<entry_t>& table) {
+    int s = dense[source];
+    for (int d = 0; d < (int)nodes.size(); d++) {
+        entry_t entry;
+        entry.dest = nodes[d]->id;
+        entry.next_hop = pv_hop[s][d] < 0 ? -1 : nodes[pv_hop[s][d]]->id;
+        entry.path_cost = pv_hop[s][d] < 0 ? -1 : pv_dist[s][d];
+        table.push_back(entry);
+    }
+}
+
+/**
+ * Print how much memory the shared path cells take compared with
+ * keeping each route's path as its own vector.
+ */
+void pv_report() {
+    // path lengths; a tail always has a lower index after collecting
+    vector<int> length(cells.size());
+    for (int c = 0; c < (int)cells.size(); c++) {
+        length[c] = cells[c].tail < 0 ? 1 : length[cells[c].tail] + 1;
+    }
+    long routes = 0, hops = 0;
+    for (auto& row : pv_path) {
+        for (int path : row) {
+            if (path >= 0) {
+                routes++;
+                hops += length[path];
+            }
+        }
+    }
+    size_t bytes = cells.size() * sizeof(path_cell_t);
+    size_t plain = routes * sizeof(vector<int>) + hops * sizeof(int);
+    cout << "Path vector:     " << routes << " paths in " << cells.size() << " shared cells, "
+         << bytes << " bytes vs " << plain << " bytes as per-route vectors" << endl;
+}
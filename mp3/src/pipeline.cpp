@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "linkstate.h"
+
+using namespace std;
+
+typedef map<int, vector<entry_t>> tables_t;
+
+/**
+ * Compute one epoch's tables on a pipeline worker thread.  The worker
+ * gets its own copy of the topology, since the main thread goes on to
+ * apply the next change, and it has no output file open, so
+ * update_tables() only fills its thread's routing_table.
+ *
+ * @param topo    Private copy of the epoch's topology, freed here
+ * @param threads The main thread's engine_threads
+ * @return        The finished tables, frozen from here on
+ */
+static tables_t compute_epoch(map<int, node_t*> topo, int threads) {
+    engine_threads = threads;
+    topology = move(topo);
+    update_tables();
+    for (auto p : topology) {
+        delete p.second;
+    }
+    topology.clear();
+    return move(routing_table);
+}
+
+/**
+ * Copy the current topology for a pipeline worker.
+ */
+static map<int, node_t*> copy_topology() {
+    map<int, node_t*> copy;
+    for (auto p : topology) {
+        copy[p.first] = new node_t(*p.second);
+    }
+    return copy;
+}
+
+/**
+ * Pipelined version of run_epochs().  While the main thread prints
+ * the tables of epoch k and traces its messages over them, a worker
+ * already computes epoch k + 1 from the topology with the next change
+ * applied.  The main thread still writes every epoch in full before
+ * the next one, so the output is the same as a sequential run.
+ *
+ * @return Number of epochs run, one more than the changes applied
+ */
+int run_pipelined() {
+    typedef chrono::steady_clock clock;
+    double stall_ms = 0, output_ms = 0;
+    auto start = clock::now();
+
+    int epochs = 0;
+    future<tables_t> next = async(launch::async, compute_epoch, copy_topology(), engine_threads);
+    while (1) {
+        epochs++;
+        auto wait = clock::now();
+        routing_table = next.get();
+        stall_ms += chrono::duration<double, milli>(clock::now() - wait).count();
+
+        // start on the next epoch before writing this one out
+        bool more = apply_changes() != 0;
+        if (more) {
+            next = async(launch::async, compute_epoch, copy_topology(), engine_threads);
+        }
+
+        auto write = clock::now();
+        for (auto& table : routing_table) {
+            print_table(table.second);
+            outfile << endl;
+        }
+        send_messages();
+        output_ms += chrono::duration<double, milli>(clock::now() - write).count();
+
+        if (!more) {
+            break;
+        }
+    }
+
+    double total_ms = chrono::duration<double, milli>(clock::now() - start).count();
+    printf("Pipeline: %d epochs in %.1f ms, %.1f ms writing output, %.1f ms waiting for tables\n",
+           epochs, total_ms, output_ms, stall_ms);
+    return epochs;
+}
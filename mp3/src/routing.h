@@ -19,6 +19,20 @@ typedef struct rte {
     int         path_cost;      // total path cost to dest
 } entry_t;
 
+#ifdef DISTVEC
+/**
+ * Cost Row Struct
+ *   A view of one distance vector a node keeps: its own, or the
+ *   last one a neighbor sent.  The costs live in a flat store
+ *   shared by every node's table, one cache-line aligned row each.
+ */
+typedef struct cost_row {
+    int         node;           // dense index of the node the vector belongs to
+    bool        heard;          // false until that node has sent a vector
+    int*        cost;           // cost to each destination, by dense index
+} cost_row_t;
+#endif
+
 /**
  * Routing Node Struct
  *   Stores information for routing
@@ -27,7 +41,8 @@ typedef struct routing_node {
     int                     id;         // node ID
     unordered_map<int, int> neighbors;  // <neighbor ID, path cost>
     #ifdef DISTVEC
-    vector<vector<int>>     cost_table; // matrix of costs from one node to another
+    vector<cost_row_t>      cost_table; // rows this node keeps, sorted by node
+    vector<int>             next_hop;   // next hop to each node, by dense index
     #endif
 } node_t;
 
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+using namespace std;
+
+// chunks cut per thread, so there is something left to steal
+#define SCHED_CHUNKS_PER_THREAD 8
+
+/**
+ * Estimate how long each source's shortest path search takes: it
+ * settles every node of the source's component and scans every link,
+ * so a hub in the giant component costs the whole graph while a node
+ * in a small disconnected pocket costs next to nothing.
+ *
+ * @param graph Graph the searches run on
+ * @param cost  Filled with the estimated cost of each source
+ */
+void source_costs(const graph_t& graph, vector<long>& cost) {
+    int n = graph.ids.size();
+    vector<int> component(n, -1), stack;
+    vector<long> size;
+    for (int s = 0; s < n; s++) {
+        if (component[s] >= 0) {
+            continue;
+        }
+        // nodes plus link ends of s's component
+        long work = 0;
+        component[s] = size.size();
+        stack.push_back(s);
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            work += 1 + graph.offset[u + 1] - graph.offset[u];
+            for (int e = graph.offset[u]; e < graph.offset[u + 1]; e++) {
+                if (component[graph.adj[e]] < 0) {
+                    component[graph.adj[e]] = size.size();
+                    stack.push_back(graph.adj[e]);
+                }
+            }
+        }
+        size.push_back(work);
+    }
+    cost.resize(n);
+    for (int s = 0; s < n; s++) {
+        cost[s] = size[component[s]];
+    }
+}
+
+/**
+ * Work-Stealing Deque Struct
+ *   One thread's chunks of task indices.  The owner works from the
+ *   back, thieves take from the front, so the two rarely meet.
+ */
+typedef struct steal_deque {
+    mutex                   lock;
+    deque<pair<int, int>>   chunks;     // [first, last) task ranges
+} steal_deque_t;
+
+/**
+ * Run body(i, thread) for every task i on a pool of threads with work
+ * stealing.  Tasks are cut into consecutive chunks of about equal
+ * estimated cost, a few per thread, and each thread starts with an
+ * equal share of the total cost in its own deque.  A thread that runs
+ * dry steals a chunk from the front of another thread's deque, so a
+ * thread stuck on expensive tasks has its remaining work taken over
+ * instead of holding everyone up.  The thread index lets the body keep
+ * per-thread scratch state.
+ *
+ * @param cost    Estimated cost of each task, all positive
+ * @param threads Number of threads, including the calling one
+ * @param body    Task to run, given the task index and thread index
+ * @param report  Filled with per-thread utilization
+ */
+void steal_for(const vector<long>& cost, int threads, const function<void(int, int)>& body, sched_report_t& report) {
+    typedef chrono::steady_clock clock;
+    auto start = clock::now();
+    int count = cost.size();
+    threads = max(1, min(threads, count));
+
+    long total = 0;
+    for (long c : cost) {
+        total += c;
+    }
+    long target = max(1L, total / (threads * SCHED_CHUNKS_PER_THREAD));
+
+    // cut the chunks, then deal them out in equal shares of cost
+    vector<steal_deque_t> deques(threads);
+    report.chunks = 0;
+    long done = 0;
+    for (int first = 0; first < count; ) {
+        int last = first;
+        long work = 0;
+        while (last < count && (work < target || last == first)) {
+            work += cost[last++];
+        }
+        int t = min((long)threads - 1, (done + work / 2) * threads / max(1L, total));
+        deques[t].chunks.push_back(make_pair(first, last));
+        report.chunks++;
+        done += work;
+        first = last;
+    }
+
+    report.busy_ms.assign(threads, 0);
+    report.tasks.assign(threads, 0);
+    report.steals.assign(threads, 0);
+
+    auto worker = [&](int t) {
+        while (1) {
+            pair<int, int> chunk(-1, -1);
+            {
+                lock_guard<mutex> own(deques[t].lock);
+                if (!deques[t].chunks.empty()) {
+                    chunk = deques[t].chunks.back();
+                    deques[t].chunks.pop_back();
+                }
+            }
+            // nothing left here, try the other threads in turn
+            for (int v = 1; chunk.first < 0 && v < threads; v++) {
+                steal_deque_t& victim = deques[(t + v) % threads];
+                lock_guard<mutex> other(victim.lock);
+                if (!victim.chunks.empty()) {
+                    chunk = victim.chunks.front();
+                    victim.chunks.pop_front();
+                    report.steals[t]++;
+                }
+            }
+            // chunks are never added, so once all deques are empty we're done
+            if (chunk.first < 0) {
+                return;
+            }
+
+            auto begin = clock::now();
+            for (int i = chunk.first; i < chunk.second; i++) {
+                body(i, t);
+            }
+            report.busy_ms[t] += chrono::duration<double, milli>(clock::now() - begin).count();
+            report.tasks[t] += chunk.second - chunk.first;
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.push_back(thread(worker, t));
+    }
+    worker(0);
+    for (auto& t : pool) {
+        t.join();
+    }
+    report.wall_ms = chrono::duration<double, milli>(clock::now() - start).count();
+}
+
+/**
+ * Print a steal_for() run's per-thread utilization: the share of the
+ * wall time each thread spent running tasks.
+ *
+ * @param what   What the tasks were
+ * @param report Report from steal_for()
+ */
+void sched_print(const char* what, const sched_report_t& report) {
+    int steals = 0;
+    for (int s : report.steals) {
+        steals += s;
+    }
+    cout << "Scheduler: " << what << " on " << report.busy_ms.size() << " threads in "
+         << report.wall_ms << " ms, " << report.chunks << " chunks, " << steals << " steals, utilization";
+    for (size_t t = 0; t < report.busy_ms.size(); t++) {
+        cout << " " << (report.wall_ms > 0 ? (int)(100 * report.busy_ms[t] / report.wall_ms) : 100) << "%"
+             << "/" << report.tasks[t];
+    }
+    cout << endl;
+}
@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stream.h"
+
+using namespace std;
+
+// read messages straight from the mapped file instead of message_list
+bool stream_mode = false;
+
+// the message file, mapped read-only for the whole run
+static const char* stream_map = NULL;
+static size_t stream_size = 0;
+// lines in the file, one message each
+static long stream_lines = 0;
+
+/**
+ * Map the message file.  Nothing is parsed yet; every epoch scans
+ * the mapping again, so no copy of the messages stays in memory.
+ *
+ * @param path Message file
+ * @return     false if the file could not be mapped
+ */
+bool stream_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("stream: open");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("stream: fstat");
+        close(fd);
+        return false;
+    }
+
+    stream_size = st.st_size;
+    if (stream_size > 0) {
+        void* map = mmap(NULL, stream_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("stream: mmap");
+            close(fd);
+            stream_size = 0;
+            return false;
+        }
+        stream_map = (const char*)map;
+        madvise(map, stream_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // count the lines as getline() would see them
+    stream_lines = 0;
+    const char* end = stream_map + stream_size;
+    for (const char* p = stream_map; p < end; stream_lines++) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        p = eol ? eol + 1 : end;
+    }
+    return true;
+}
+
+/**
+ * Number of messages in the mapped file.
+ */
+long stream_count() {
+    return stream_lines;
+}
+
+/**
+ * Parse the mapped file STREAM_BATCH messages at a time and hand each
+ * one to send, in file order.  Lines are split exactly as
+ * read_messages() splits them.  Pages of the file already sent are
+ * dropped from the process as the scan moves on, so a file of any
+ * size only ever has about a batch of it resident.
+ *
+ * @param send Called with every message
+ */
+void stream_messages(const function<void(const message_t&)>& send) {
+    long page = sysconf(_SC_PAGESIZE);
+    const char* end = stream_map + stream_size;
+    const char* dropped = stream_map;
+    vector<message_t> batch(STREAM_BATCH);
+    string line;
+    int src = 0, dest = 0;
+
+    const char* p = stream_map;
+    while (p < end) {
+        int count = 0;
+        for (; count < STREAM_BATCH && p < end; count++) {
+            const char* eol = (const char*)memchr(p, '\n', end - p);
+            line.assign(p, eol ? eol : end);
+            p = eol ? eol + 1 : end;
+
+            // save the souce and dest from the line, then find the
+            // start of the message (after the second space)
+            sscanf(line.c_str(), "%d %d %*s", &src, &dest);
+            line = line.substr(line.find(' ') + 1);
+            batch[count].src = src;
+            batch[count].dest = dest;
+            batch[count].message = line.substr(line.find(' ') + 1);
+        }
+
+        for (int i = 0; i < count; i++) {
+            send(batch[i]);
+        }
+
+        // let go of the whole pages behind this batch
+        const char* keep = stream_map + (p - stream_map) / page * page;
+        if (keep > dropped) {
+            madvise((void*)dropped, keep - dropped, MADV_DONTNEED);
+            dropped = keep;
+        }
+    }
+}
+
+/**
+ * Unmap the message file.
+ */
+void stream_close() {
+    if (stream_map != NULL) {
+        munmap((void*)stream_map, stream_size);
+    }
+    stream_map = NULL;
+    stream_size = 0;
+    stream_lines = 0;
+}
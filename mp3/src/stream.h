@@ -0,0 +1,21 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <functional>
+
+#include "routing.h"
+
+using namespace std;
+
+// messages parsed from the mapped file before they are sent
+#define STREAM_BATCH        4096
+
+bool stream_open(const char* path);
+long stream_count();
+void stream_messages(const function<void(const message_t&)>& send);
+void stream_close();
+
+// read messages straight from the mapped file instead of message_list
+extern bool stream_mode;
+
+#endif /* _STREAM_H */
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "linkstate.h"
+
+using namespace std;
+
+/**
+ * Number every link once, in (lower end, upper end) order, and map
+ * both directions of its adjacency entries to that number.
+ */
+static void number_links(const graph_t& graph, vector<int>& link_of, vector<impact_t>& impact) {
+    int n = graph.ids.size();
+    link_of.assign(graph.adj.size(), -1);
+    impact.clear();
+    for (int u = 0; u < n; u++) {
+        for (int e = graph.offset[u]; e < graph.offset[u + 1]; e++) {
+            int v = graph.adj[e];
+            if (u < v) {
+                link_of[e] = impact.size();
+                impact.push_back(impact_t{u, v, graph.cost[e], 0, 0, 0, 0, 0});
+            }
+            else {
+                // the upper end's row was numbered when v was visited
+                auto first = graph.adj.begin() + graph.offset[v];
+                auto last = graph.adj.begin() + graph.offset[v + 1];
+                link_of[e] = link_of[lower_bound(first, last, u) - graph.adj.begin()];
+            }
+        }
+    }
+}
+
+/**
+ * Work out, for one source, what every failure of one of its tree
+ * links does to its routes.  Taking out the link above v only cuts
+ * off v's subtree, so only those destinations are recomputed: each
+ * one starts from its cheapest link into the rest of the tree, whose
+ * costs are unchanged, and a Dijkstra confined to the subtree settles
+ * the remaining costs.  Links outside the tree change no route.
+ *
+ * @param graph   Graph to analyse
+ * @param buckets Use bucket_tree() instead of shortest_path_tree()
+ * @param link_of Link number of every adjacency entry
+ * @param source  Dense index of the source
+ * @param result  Filled with the impact on this source, one entry per tree link
+ */
+static void source_failures(const graph_t& graph, bool buckets, const vector<int>& link_of,
+                            int source, vector<pair<int, impact_t>>& result) {
+    int n = graph.ids.size();
+    spt_t tree;
+    if (buckets) {
+        bucket_tree(graph, source, max_link_cost(graph), tree);
+    }
+    else {
+        shortest_path_tree(graph, source, tree);
+    }
+
+    // children of every node, in ID order
+    vector<int> first(n + 1, 0), child(n);
+    for (int v = 0; v < n; v++) {
+        if (v != source && tree.parent[v] >= 0) {
+            first[tree.parent[v] + 1]++;
+        }
+    }
+    for (int v = 0; v < n; v++) {
+        first[v + 1] += first[v];
+    }
+    vector<int> fill(first.begin(), first.end() - 1);
+    for (int v = 0; v < n; v++) {
+        if (v != source && tree.parent[v] >= 0) {
+            child[fill[tree.parent[v]]++] = v;
+        }
+    }
+
+    // preorder numbering, so a subtree is one contiguous range
+    vector<int> order, begin(n, -1), end(n, -1), stack(1, source);
+    while (!stack.empty()) {
+        int u = stack.back();
+        stack.pop_back();
+        begin[u] = order.size();
+        order.push_back(u);
+        for (int i = first[u + 1] - 1; i >= first[u]; i--) {
+            stack.push_back(child[i]);
+        }
+    }
+    for (int i = order.size() - 1; i >= 0; i--) {
+        int u = order[i];
+        end[u] = begin[u] + 1;
+        for (int c = first[u]; c < first[u + 1]; c++) {
+            end[u] = max(end[u], end[child[c]]);
+        }
+    }
+
+    result.clear();
+    vector<int> cost(n, INT_MAX);
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> heap;
+    for (int v : order) {
+        if (v == source) {
+            continue;
+        }
+        int up = tree.parent[v];
+        int lo = begin[v], hi = end[v];
+        auto inside = [&](int x) { return begin[x] >= lo && begin[x] < hi; };
+
+        // cheapest way into the subtree from the untouched part of the tree
+        for (int i = lo; i < hi; i++) {
+            int x = order[i];
+            for (int e = graph.offset[x]; e < graph.offset[x + 1]; e++) {
+                int y = graph.adj[e];
+                if (begin[y] < 0 || inside(y) || (x == v && y == up)) {
+                    continue;
+                }
+                cost[x] = min(cost[x], tree.dist[y] + graph.cost[e]);
+            }
+            if (cost[x] != INT_MAX) {
+                heap.push(make_pair(cost[x], x));
+            }
+        }
+
+        // then settle the subtree on its own links
+        while (!heap.empty()) {
+            int d = heap.top().first;
+            int x = heap.top().second;
+            heap.pop();
+            if (d > cost[x]) {
+                continue;
+            }
+            for (int e = graph.offset[x]; e < graph.offset[x + 1]; e++) {
+                int y = graph.adj[e];
+                if (inside(y) && d + graph.cost[e] < cost[y]) {
+                    cost[y] = d + graph.cost[e];
+                    heap.push(make_pair(cost[y], y));
+                }
+            }
+        }
+
+        // link from v up to its parent
+        auto row = graph.adj.begin() + graph.offset[v];
+        int link = link_of[lower_bound(row, graph.adj.begin() + graph.offset[v + 1], up) - graph.adj.begin()];
+        impact_t r = impact_t{0, 0, 0, hi - lo, 0, 0, 0, 0};
+        for (int i = lo; i < hi; i++) {
+            int x = order[i];
+            if (cost[x] == INT_MAX) {
+                r.unreachable++;
+            }
+            else if (cost[x] > tree.dist[x]) {
+                int added = cost[x] - tree.dist[x];
+                r.costlier++;
+                r.added += added;
+                r.max_added = max(r.max_added, added);
+            }
+            cost[x] = INT_MAX;
+        }
+        result.push_back(make_pair(link, r));
+    }
+}
+
+/**
+ * Work out the impact of every single link failure on the routes of
+ * every source, without rerunning the full table computation per
+ * link.  Sources are spread over the worker threads by the work-stealing
+ * scheduler and each thread adds up its own results per link, which
+ * are then merged.
+ *
+ * @param graph   Graph to analyse
+ * @param buckets Use bucket_tree() instead of shortest_path_tree()
+ * @param threads Number of worker threads
+ * @param impact  Filled with one entry per link, in (a, b) order
+ */
+void link_failures(const graph_t& graph, bool buckets, int threads, vector<impact_t>& impact) {
+    vector<int> link_of;
+    number_links(graph, link_of, impact);
+
+    vector<long> cost;
+    source_costs(graph, cost);
+    threads = max(1, min(threads, (int)cost.size()));
+    vector<vector<impact_t>> partial(threads, impact);
+    sched_report_t report;
+    steal_for(cost, threads, [&](int source, int t) {
+        vector<pair<int, impact_t>> result;
+        source_failures(graph, buckets, link_of, source, result);
+        for (auto& p : result) {
+            impact_t& total = partial[t][p.first];
+            total.routes += p.second.routes;
+            total.costlier += p.second.costlier;
+            total.unreachable += p.second.unreachable;
+            total.added += p.second.added;
+            total.max_added = max(total.max_added, p.second.max_added);
+        }
+    }, report);
+    if (threads > 1) {
+        sched_print("link failures", report);
+    }
+
+    for (auto& part : partial) {
+        for (size_t l = 0; l < impact.size(); l++) {
+            impact[l].routes += part[l].routes;
+            impact[l].costlier += part[l].costlier;
+            impact[l].unreachable += part[l].unreachable;
+            impact[l].added += part[l].added;
+            impact[l].max_added = max(impact[l].max_added, part[l].max_added);
+        }
+    }
+}
+
+/**
+ * Write the failure impact report for the current topology to the
+ * output file: one line per link in ID order, then a summary.
+ */
+void whatif_report() {
+    graph_t graph;
+    build_graph(topology, graph);
+    bool buckets = max_link_cost(graph) <= DIAL_MAX_COST;
+    int threads = worker_threads();
+
+    vector<impact_t> impact;
+    link_failures(graph, buckets, threads, impact);
+
+    long used = 0, bridges = 0;
+    const impact_t* worst = NULL;
+    for (auto& link : impact) {
+        outfile << "link " << graph.ids[link.a] << " " << graph.ids[link.b]
+                << " cost " << link.cost
+                << " routes " << link.routes
+                << " costlier " << link.costlier
+                << " unreachable " << link.unreachable
+                << " added " << link.added
+                << " max " << link.max_added << endl;
+
+        if (link.routes > 0) {
+            used++;
+        }
+        if (link.unreachable > 0) {
+            bridges++;
+        }
+        if (worst == NULL || link.routes > worst->routes) {
+            worst = &link;
+        }
+    }
+
+    outfile << endl << impact.size() << " links, " << used << " carry routes, "
+            << bridges << " disconnect the network";
+    if (worst != NULL) {
+        outfile << ", busiest " << graph.ids[worst->a] << " " << graph.ids[worst->b]
+                << " with " << worst->routes << " routes";
+    }
+    outfile << endl;
+}